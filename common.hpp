@@ -14,6 +14,34 @@
 enum class RunMode {
     Normal,
     Dry,
+    Emulated,
+};
+
+enum class UpdateMode {
+    Full,
+    Differential,
+    Partial,
+};
+
+/* How rendering is turned on its way to the panel */
+enum class Rotation {
+    None,
+    Clockwise,
+    UpsideDown,
+    CounterClockwise,
+};
+
+/* How a panel is wired to the host, by default as on the Waveshare HAT */
+struct Wiring {
+    std::string spi_device = "/dev/spidev0.0";
+    uint32_t reset_pin = 17;
+    uint32_t control_pin = 25;
+    uint32_t busy_pin = 24;
+};
+
+enum class ReplaySpeed {
+    Original,
+    Max,
 };
 
 struct Logger {
@@ -22,11 +50,14 @@ struct Logger {
         CurlList,
         CurlMime,
         Display,
+        DisplayWorker,
+        Emulator,
         Forecast,
         Gpio,
         Hwif,
         MessageQueue,
         Screen,
+        Trace,
         Ukko,
         Weather,
         WebConnection,
@@ -78,12 +109,21 @@ struct Logger {
             case Facility::Display:
                 return fmt::fg(fmt::color::purple);
 
+            case Facility::DisplayWorker:
+                return fmt::fg(fmt::color::medium_purple);
+
+            case Facility::Emulator:
+                return fmt::fg(fmt::color::orange);
+
             case Facility::Hwif:
                 return fmt::fg(fmt::color::light_pink);
 
             case Facility::MessageQueue:
                 return fmt::fg(fmt::color::crimson);
 
+            case Facility::Trace:
+                return fmt::fg(fmt::color::khaki);
+
             case Facility::Weather:
                 return fmt::fg(fmt::color::light_green);
 
@@ -125,12 +165,21 @@ struct Logger {
             case Facility::Display:
                 return "Display";
 
+            case Facility::DisplayWorker:
+                return "Display::Worker";
+
+            case Facility::Emulator:
+                return "Emulator";
+
             case Facility::Hwif:
                 return "Hwif";
 
             case Facility::MessageQueue:
                 return "MessageQueue";
 
+            case Facility::Trace:
+                return "Trace";
+
             case Facility::Weather:
                 return "Weather";
 
@@ -178,6 +227,8 @@ struct Options {
     std::optional<std::string> render_store{};
     std::optional<std::string> netatmo_store{};
     std::optional<std::string> netatmo_load{};
+    std::optional<std::string> trace_store{};
+    std::optional<std::string> trace_load{};
 
     std::string settings_file = "/etc/ukko.lua";
 
@@ -185,15 +236,30 @@ struct Options {
     std::chrono::minutes retry_sleep{5};
     std::chrono::minutes forecast_frequency{120};
     std::chrono::minutes weather_frequency{30};
+    std::chrono::minutes standby_limit{15};
+    std::chrono::minutes full_refresh_interval{24 * 60};
 
+    uint32_t fast_refreshes{};
+
+    bool render_store_async = false;
+    bool grayscale = false;
+    bool dual_spi = false;
     bool dump_traffic = true;
     bool verbose = false;
     bool debug_log = false;
     RunMode run_mode = DUMMY ? RunMode::Dry : RunMode::Normal;
-    std::string spi_device = "/dev/spidev0.0";
+    UpdateMode update_mode = UpdateMode::Full;
+    Rotation rotation = Rotation::None;
+    ReplaySpeed replay_speed = ReplaySpeed::Original;
+    Wiring wiring{};
 
+    /* Hardware is not touched when emulating either */
     bool is_dry() const {
-        return run_mode == RunMode::Dry;
+        return run_mode != RunMode::Normal;
+    }
+
+    bool is_emulated() const {
+        return run_mode == RunMode::Emulated;
     }
 
     Logger get_logger(Logger::Facility facility, bool force_enabled = false) const {
@@ -203,9 +269,3 @@ struct Options {
         return Logger(facility, debug_log || force_enabled);
     }
 };
-
-/* We're assuming A1 format, monochrome */
-static constexpr uint32_t WIDTH = 800;
-static constexpr uint32_t STRIDE = utils::div_ceil<uint32_t>(WIDTH, 8);
-static constexpr uint32_t HEIGHT = 480;
-static constexpr uint32_t IMG_SIZE = WIDTH * STRIDE;
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <csignal>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "display.hpp"
+#include "framebuffer.hpp"
+#include "gpio.hpp"
+#include "hwif.hpp"
+#include "mailbox.hpp"
+#include "stats.hpp"
+
+/**
+ * Owns the hardware of one display, and draws frames on a thread of its own, so that several
+ * displays can refresh at the same time. Only the latest submitted frame is drawn, frames submitted
+ * while display is busy replace each other. Display counters are summarised after each draw, and
+ * should be dumped in full when the process receives `dump_signal`
+ */
+template <typename Panel> struct DisplayWorker {
+    static constexpr int dump_signal = SIGUSR1;
+
+    DisplayWorker(const Options &options)
+        : options{options}
+        , control_pins{options}
+        , hwif{options, control_pins}
+        , display{options, hwif}
+        , thread{&DisplayWorker::run, this} {
+    }
+
+    ~DisplayWorker() {
+        frames.close();
+        thread.join();
+    }
+
+    /**
+     * Hand over a frame to be drawn, along with when the next frame is expected. If drawing a
+     * previous frame failed, the error is rethrown here
+     */
+    void submit(Framebuffer image, std::chrono::time_point<std::chrono::system_clock> next_update) {
+        if (std::exception_ptr failure = take_error()) {
+            std::rethrow_exception(failure);
+        }
+        Frame frame{
+            .image = std::move(image),
+            .next_update = next_update,
+        };
+        if (frames.put(std::move(frame))) {
+            log("Replaced frame not yet drawn");
+        }
+    }
+
+    void dump_stats() {
+        log("Counters for {}", options.wiring.spi_device);
+        for (const std::string &line : stats::format(hwif.stats().all())) {
+            log("{}", line);
+        }
+    }
+
+  private:
+    struct Frame {
+        Framebuffer image;
+        std::chrono::time_point<std::chrono::system_clock> next_update;
+    };
+
+    void run() {
+        using namespace std::chrono;
+
+        while (std::optional<Frame> frame = frames.take()) {
+            try {
+                const auto until_next =
+                    duration_cast<seconds>(frame->next_update - system_clock::now());
+                if (options.grayscale) {
+                    display.draw_gray(std::move(frame->image), until_next);
+                } else {
+                    display.draw(frame->image, until_next);
+                }
+                for (const std::string &line : stats::format(hwif.stats().take_recent())) {
+                    log("{}", line);
+                }
+            } catch (const std::exception &err) {
+                log("Failed to draw frame: {}", err.what());
+                std::unique_lock<std::mutex> lock{mutex};
+                error = std::current_exception();
+            }
+        }
+        log("No more frames to draw");
+    }
+
+    std::exception_ptr take_error() {
+        std::unique_lock<std::mutex> lock{mutex};
+        return std::exchange(error, nullptr);
+    }
+
+    const Options &options;
+    const Logger log = options.get_logger(Logger::Facility::DisplayWorker);
+
+    hwif::Pins control_pins;
+    hwif::Hwif<Panel> hwif;
+    Display<Panel> display;
+
+    Mailbox<Frame> frames{};
+    std::mutex mutex{};
+    std::exception_ptr error{};
+
+    /* Started last, once everything it uses is constructed */
+    std::thread thread;
+};
@@ -2,81 +2,79 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <bit>
 #include <cairomm/surface.h>
 #include <cassert>
-#include <fmt/os.h>
+#include <chrono>
+#include <cstring>
+#include <fmt/chrono.h>
+#include <future>
+#include <optional>
 
+#include "framebuffer.hpp"
 #include "hwif.hpp"
+#include "pbm.hpp"
+#include "rect.hpp"
+#include "rotation.hpp"
 #include "utils.hpp"
+#include "waveform.hpp"
 
-struct Display {
-    Display(const Options &options, hwif::Hwif &hwif) : hwif(hwif), options(options) {
+/**
+ * Drives a display panel described by `Panel`, which holds its geometry, init script and waveforms
+ */
+template <typename Panel> struct Display {
+    /**
+     * Power state of the display controller
+     */
+    enum class PowerState {
+        Off,       // Not yet initialised
+        DeepSleep, // Needs reset and initialisation before use
+        Standby,   // Powered off, but keeps its configuration
+        Active,    // Powered on and configured
+    };
+
+    Display(const Options &options, hwif::Hwif<Panel> &hwif) : hwif(hwif), options(options) {
     }
 
     /**
      * Wake up display
      */
     void wake_up() {
-        using namespace std::literals::chrono_literals;
-        using namespace hwif;
+        stats::Scope phase{hwif.stats(), "wake_up"};
         hwif.reset();
-        hwif.send(Command::PowerSettings, {0x17, 0x17, 0x3f, 0x3f, 0x11}); // Power setting
-        hwif.send(Command::VCOMDCSetting, {0x24});                         // VCOM
-        hwif.send(Command::BoosterSoftStart, {0x27, 0x27, 0x2f, 0x17});    // Booster soft start
-        hwif.send(Command::PLLControl, {0x06});                            // PLL control
-        hwif.send(Command::PowerOn);                                       // Power on
-        std::this_thread::sleep_for(100ms);
-        hwif.wait_for_idle();
-        hwif.send(Command::PanelSettings, {0x3f});                       // Panel settings
-        hwif.send(Command::ResolutionSetting, {0x03, 0x20, 0x01, 0xe0}); // Resolution settings
-        hwif.send(Command::DualSPI, {0x00});                             // Dual SPI
-        hwif.send(Command::VCOMDataIntervalSetting, {0x10, 0x00});       // VCOM and data interval
-        hwif.send(Command::TCONSetting, {0x22});                         // TCON
-        hwif.send(Command::GateSourceStartSetting, {0x00, 0x00, 0x00, 0x00}); // Gate/source start
-
-        /* LUT setup */
-        hwif.send(Command::LutVcom,
-                  {
-                      /* LUT VCOM */
-                      0x0, 0xF, 0xF, 0x0, 0x0, 0x1, 0x0, 0xF, 0x1, 0xF, 0x1, 0x2, 0x0, 0xF,
-                      0xF, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
-                      0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
-                  });
-        hwif.send(Command::LutBlue,
-                  {
-                      /* LUT WW */
-                      0x10, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x20, 0xF,
-                      0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                      0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                  });
-        hwif.send(Command::LutWhite,
-                  {
-                      /* LUT BW */
-                      0x10, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x20, 0xF,
-                      0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                      0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                  });
-        hwif.send(Command::LutGray1,
-                  {
-                      /* LUT WB */
-                      0x80, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x40, 0xF,
-                      0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                      0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-
-                  });
-        hwif.send(Command::LutGray2,
-                  {
-                      /* LUT BB */
-                      0x80, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x40, 0xF,
-                      0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                      0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
-                  });
+        hwif.send_script(Panel::init, Panel::power_on_timeout);
+        if (options.dual_spi) {
+            hwif.send(hwif::Command::DualSPI, {Panel::dual_spi});
+        }
+
+        /* Look up tables are lost on reset */
+        loaded_waveform = nullptr;
+    }
+
+    /**
+     * Load look up tables for `profile`, unless already loaded
+     */
+    void load_waveform(const waveform::Profile &profile) {
+        using namespace hwif;
+
+        if (loaded_waveform == &profile) {
+            return;
+        }
+        stats::Scope phase{hwif.stats(), "load_waveform"};
+        log("Loading {} waveform", profile.name);
+        hwif.send(Command::LutVcom, profile.vcom);
+        hwif.send(Command::LutBlue, profile.ww);
+        hwif.send(Command::LutWhite, profile.bw);
+        hwif.send(Command::LutGray1, profile.wb);
+        hwif.send(Command::LutGray2, profile.bb);
+        loaded_waveform = &profile;
     }
 
     void clear() {
         using namespace hwif;
-        std::vector<uint8_t> buffer = std::vector<uint8_t>(IMG_SIZE);
-        assert(buffer.size() == IMG_SIZE);
+        stats::Scope phase{hwif.stats(), "clear"};
+        std::vector<uint8_t> buffer = std::vector<uint8_t>(Panel::image_size);
+        assert(buffer.size() == Panel::image_size);
 
         log("Clearing display");
         std::ranges::fill(buffer, 0xFF);
@@ -87,12 +85,9 @@ struct Display {
     }
 
     void refresh() {
-        using namespace std::literals::chrono_literals;
-
+        stats::Scope phase{hwif.stats(), "refresh"};
         log("Refreshing screen");
-        hwif.send(hwif::Command::DisplayRefresh);
-        std::this_thread::sleep_for(100ms); // Sample code claims this to be needed
-        hwif.wait_for_idle();
+        hwif.send_and_wait(hwif::Command::DisplayRefresh, Panel::refresh_timeout);
     }
 
     void enter_sleep() {
@@ -102,72 +97,402 @@ struct Display {
         hwif.send(Command::DeepSleep, {0xA5});
     }
 
+    /**
+     * Read temperature of the panel from the internal sensor of the controller, in whole degrees
+     * Celsius. The sensor is read as two bytes, where the first holds whole degrees
+     */
+    int read_temperature() {
+        const std::vector<uint8_t> reading =
+            hwif.read(hwif::Command::TemperatureSensorCalibration, 2);
+        const int degrees = static_cast<int8_t>(reading[0]);
+        log("Panel temperature is {}°C", degrees);
+        return degrees;
+    }
+
+    /**
+     * Make sure display is powered on and configured, doing only what the current power state
+     * requires. Returns true if the display had to be initialised from scratch
+     */
+    bool power_up() {
+        using namespace hwif;
+        stats::Scope phase{hwif.stats(), "power_up"};
+
+        switch (power_state) {
+            case PowerState::Off:
+            case PowerState::DeepSleep:
+                log("Waking display");
+                wake_up();
+                power_state = PowerState::Active;
+                return true;
+
+            case PowerState::Standby:
+                log("Powering on display");
+                hwif.send_and_wait(Command::PowerOn, Panel::power_on_timeout);
+                power_state = PowerState::Active;
+                return false;
+
+            case PowerState::Active:
+                break;
+        }
+        return false;
+    }
+
+    /**
+     * Power down display. If the next update is close, then only power off the display, so it
+     * keeps its configuration. Otherwise put it in deep sleep
+     */
+    void power_down(std::chrono::seconds until_next) {
+        using namespace hwif;
+        stats::Scope phase{hwif.stats(), "power_down"};
+
+        if (until_next < options.standby_limit) {
+            log("Powering off display, next update in {}", until_next);
+            hwif.send_and_wait(Command::PowerOff, Panel::power_on_timeout);
+            power_state = PowerState::Standby;
+        } else {
+            log("Sleeping, next update in {}", until_next);
+            enter_sleep();
+            power_state = PowerState::DeepSleep;
+        }
+    }
+
     /**
      * Render framebuffer to screen
      */
     void paint_framebuffer() {
         using namespace hwif;
+        stats::Scope phase{hwif.stats(), "paint_framebuffer"};
 
         log("Drawing framebuffer to display");
-        hwif.send(hwif::Command::DisplayStartTransmission2, fb);
+        hwif.send(hwif::Command::DisplayStartTransmission2, fb.bytes());
         refresh();
+    }
+
+    /**
+     * Render framebuffer to screen, with the previously drawn frame as old data. This lets the
+     * display drive only the pixels that change
+     */
+    void paint_difference() {
+        using namespace hwif;
+        stats::Scope phase{hwif.stats(), "paint_difference"};
+
+        log("Drawing framebuffer over previous frame");
+        hwif.send(Command::DisplayStartTransmission1, previous->bytes());
+        hwif.send(Command::DisplayStartTransmission2, fb.bytes());
+        refresh();
+    }
+
+    /**
+     * Render only the given regions of the framebuffer to screen, using partial window mode.
+     * Regions need to be aligned to whole bytes horizontally
+     */
+    void paint_regions(const std::vector<Rect> &regions) {
+        using namespace hwif;
+        stats::Scope phase{hwif.stats(), "paint_regions"};
+
+        for (const Rect &region : regions) {
+            assert(region.x % 8 == 0 && region.width % 8 == 0);
+            log("Drawing region {} to display", region);
+
+            /* Window end coordinates are inclusive */
+            const uint32_t x_end = region.right() - 1;
+            const uint32_t y_end = region.bottom() - 1;
+            hwif.send(Command::PartialIn);
+            hwif.send(Command::PartialWindow,
+                      {
+                          static_cast<uint8_t>(region.x >> 8),
+                          static_cast<uint8_t>(region.x & 0xf8),
+                          static_cast<uint8_t>(x_end >> 8),
+                          static_cast<uint8_t>(x_end | 0x07),
+                          static_cast<uint8_t>(region.y >> 8),
+                          static_cast<uint8_t>(region.y & 0xff),
+                          static_cast<uint8_t>(y_end >> 8),
+                          static_cast<uint8_t>(y_end & 0xff),
+                          0x01, // Gates scan both inside and outside of window
+                      });
+            hwif.send(Command::DisplayStartTransmission1, window(*previous, region));
+            hwif.send(Command::DisplayStartTransmission2, window(fb, region));
+            refresh();
+            hwif.send(Command::PartialOut);
+        }
+    }
 
-        if (options.render_store) {
-            auto out =
-                fmt::output_file(fmt::format("{}-{}.ppm", *options.render_store, screen_number));
-            out.print("P1\n");
-            out.print("{} {}\n", WIDTH, HEIGHT);
-
-            for (uint32_t row = 0; row < HEIGHT; row++) {
-                for (uint32_t col = 0; col < STRIDE; col++) {
-                    for (uint32_t bit = 0; bit < 8; bit++) {
-                        uint8_t byte = fb[row * STRIDE + col];
-                        out.print("{} ", (byte >> (7 - bit)) & 1);
-                    }
+    /**
+     * Copy the part of a frame that is covered by `region`
+     */
+    static std::vector<uint8_t> window(const Framebuffer &frame, const Rect &region) {
+        std::vector<uint8_t> result{};
+        result.reserve(region.area() / 8);
+        for (uint32_t row = region.y; row < region.bottom(); row++) {
+            const std::span<const uint8_t> line = frame.row(row);
+            std::copy(line.begin() + region.x / 8, line.begin() + region.right() / 8,
+                      std::back_inserter(result));
+        }
+        return result;
+    }
+
+    /**
+     * Store framebuffer as image, if requested. When storing asynchronously, only a previous store
+     * still in progress is waited for
+     */
+    void store_framebuffer() {
+        if (not options.render_store) {
+            return;
+        }
+
+        const std::string filename = fmt::format("{}-{}.pbm", *options.render_store, screen_number);
+        screen_number += 1;
+        if (options.render_store_async) {
+            if (pending_store.valid()) {
+                pending_store.get();
+            }
+            pending_store = std::async(std::launch::async, [filename, frame = fb] {
+                pbm::write(filename, frame.width, frame.height, frame.stride, frame.bytes());
+            });
+        } else {
+            pbm::write(filename, fb.width, fb.height, fb.stride, fb.bytes());
+        }
+    }
+
+    /**
+     * Find regions where the framebuffer differs from what was last sent to the display. Rows
+     * with changes are grouped into bands, which are then merged if they are close
+     */
+    std::vector<Rect> dirty_regions() const {
+        std::vector<Rect> bands{};
+        std::optional<Rect> band{};
+        for (uint32_t row = 0; row < Panel::height; row++) {
+            const std::span<const uint8_t> line = fb.row(row);
+            const std::span<const uint8_t> shown = previous->row(row);
+            const auto [first, _] = std::mismatch(line.begin(), line.end(), shown.begin());
+            if (first == line.end()) {
+                if (band) {
+                    bands.push_back(*band);
+                    band.reset();
                 }
-                out.print("\n");
+                continue;
+            }
+            auto last = line.end();
+            while (*(last - 1) == shown[last - 1 - line.begin()]) {
+                last--;
             }
-            screen_number += 1;
+
+            const Rect changed{
+                .x = static_cast<uint32_t>(first - line.begin()) * 8,
+                .y = row,
+                .width = static_cast<uint32_t>(last - first) * 8,
+                .height = 1,
+            };
+            band = band ? band->united(changed) : changed;
+        }
+        if (band) {
+            bands.push_back(*band);
         }
+
+        return merge_rects(std::move(bands), merge_margin);
     }
 
     /**
-     * Render an image to the inernal framebuffer
+     * Render an image to the inernal framebuffer, leaving out any row padding, and turning it to
+     * how the panel is mounted
      */
-    void render(const std::span<uint8_t, IMG_SIZE> data) {
-        assert(fb.size() >= IMG_SIZE);
-        std::ranges::transform(data, begin(fb), [](uint8_t byte) {
-            byte = (byte & 0xf0) >> 4 | (byte & ~0xf0) << 4;
-            byte = (byte & 0xcc) >> 2 | (byte & ~0xcc) << 2;
-            byte = (byte & 0xaa) >> 1 | (byte & ~0xaa) << 1;
-            return byte;
-        });
+    void render(const Framebuffer &frame) {
+        assert(frame.bits == 1);
+        /* Cairo packs A1 pixels least significant bit first, display wants them most significant
+         * bit first */
+        Framebuffer packed{frame.width, frame.height};
+        for (uint32_t row = 0; row < frame.height; row++) {
+            std::ranges::transform(frame.row(row), packed.row(row).begin(), utils::reverse_bits);
+        }
+        fb = turned(std::move(packed));
+        assert(fb.width == Panel::width && fb.height == Panel::height);
     }
 
-    void draw(const std::span<uint8_t, IMG_SIZE> data) {
-        using namespace std::literals::chrono_literals;
-        log("Waking display");
-        wake_up();
+    /**
+     * Turn image as requested by options
+     */
+    Framebuffer turned(Framebuffer frame) const {
+        using namespace std::chrono;
+        if (options.rotation == Rotation::None) {
+            return frame;
+        }
 
-        log("Clearing display");
-        clear();
-        std::this_thread::sleep_for(500ms);
+        const auto start = steady_clock::now();
+        Framebuffer result = rotation::rotate(frame, options.rotation);
+        log("Rotated frame in {}", duration_cast<microseconds>(steady_clock::now() - start));
+        return result;
+    }
 
-        render(data);
-        log("Drawing framebuffer");
-        paint_framebuffer();
+    /**
+     * Draw image on display, and power down display until it's time for the next update
+     */
+    void draw(const Framebuffer &frame, std::chrono::seconds until_next) {
+        stats::Scope phase{hwif.stats(), "draw"};
+        render(frame);
+
+        /* Without changes there is nothing to draw, unless it's time to clean up ghosting. The
+         * display is then left as is, without powering it up */
+        const auto now = std::chrono::steady_clock::now();
+        const bool partial_mode = options.update_mode == UpdateMode::Partial && previous;
+        std::vector<Rect> regions = partial_mode ? dirty_regions() : std::vector<Rect>{};
+        if (partial_mode && regions.empty() && !scheduler.choose(now, std::nullopt).cleaning) {
+            log("Nothing changed, leaving display as is");
+            return;
+        }
 
-        log("Sleeping for {} minute(s)", options.sleep.count());
-        enter_sleep();
+        /* Waveform is chosen for the temperature the panel is at now, which needs it powered */
+        const bool initialised = power_up();
+        const typename waveform::Scheduler<Panel>::Choice choice =
+            scheduler.choose(now, read_temperature());
+
+        /* Updates build on the previously drawn frame, unless it's time to clean up ghosting */
+        const bool incremental =
+            options.update_mode != UpdateMode::Full && previous && !choice.cleaning;
+        if (!incremental) {
+            regions.clear();
+        } else if (partial_mode && regions.empty()) {
+            /* Cleaning was due, but the panel is too cold for fast refreshes to have left ghosts */
+            log("Nothing changed, leaving display as is");
+            power_down(until_next);
+            return;
+        }
+
+        /* Each region needs its own refresh, so too many regions are drawn as one */
+        if (regions.size() > max_regions) {
+            Rect bounds = regions.front();
+            for (const Rect &region : regions) {
+                bounds = bounds.united(region);
+            }
+            regions = {bounds};
+        }
+
+        /* Partial refresh only pays off for small changes */
+        uint32_t dirty_area = 0;
+        for (const Rect &region : regions) {
+            dirty_area += region.area();
+        }
+        const bool partial = !regions.empty() &&
+                             dirty_area <= Panel::width * Panel::height * max_partial_percent / 100;
+
+        if (partial) {
+            load_waveform(choice.profile);
+            log("Drawing {} changed region(s)", regions.size());
+            paint_regions(regions);
+        } else if (incremental) {
+            load_waveform(choice.profile);
+            paint_difference();
+        } else {
+            /* Display content is unknown after being initialised */
+            load_waveform(Panel::full);
+            if (initialised || choice.cleaning) {
+                clear();
+            }
+
+            log("Drawing framebuffer");
+            paint_framebuffer();
+        }
+        scheduler.record(incremental ? choice.profile : Panel::full, now);
+        store_framebuffer();
+        previous = fb;
+
+        power_down(until_next);
+    }
+
+    /**
+     * Draw grayscale image, with one byte of alpha per pixel, using four levels of gray. As every
+     * pixel is driven to its level, there is no need to clear the display first
+     */
+    void draw_gray(Framebuffer pixels, std::chrono::seconds until_next) {
+        using namespace hwif;
+        using namespace std::chrono;
+
+        stats::Scope phase{hwif.stats(), "draw_gray"};
+        pixels = turned(std::move(pixels));
+        assert(pixels.bits == 8 && pixels.width == Panel::width && pixels.height == Panel::height);
+
+        const auto start = steady_clock::now();
+        Framebuffer high_plane{Panel::width, Panel::height};
+        Framebuffer low_plane{Panel::width, Panel::height};
+        for (uint32_t row = 0; row < Panel::height; row++) {
+            split_planes(pixels.row(row), high_plane.row(row), low_plane.row(row));
+        }
+        log("Split frame into gray planes in {}",
+            duration_cast<microseconds>(steady_clock::now() - start));
+
+        power_up();
+        load_waveform(Panel::gray);
+        log("Drawing gray planes");
+        hwif.send(Command::DisplayStartTransmission1, high_plane.bytes());
+        hwif.send(Command::DisplayStartTransmission2, low_plane.bytes());
+        refresh();
+        scheduler.record(Panel::gray, start);
+        store_gray(pixels);
+
+        /* Display no longer shows a monochrome frame to build on */
+        previous.reset();
+
+        power_down(until_next);
     }
 
   private:
-    hwif::Hwif &hwif;
+    /**
+     * Reduce alpha of each pixel to two bits, and split those bits into separate planes. Eight
+     * pixels are handled at once, by gathering one bit from each byte of a 64 bit word into a
+     * single byte, first pixel ending up in the most significant bit
+     */
+    static void split_planes(std::span<const uint8_t> pixels, std::span<uint8_t> high,
+                             std::span<uint8_t> low) {
+        static_assert(std::endian::native == std::endian::little);
+        static constexpr uint64_t lsbs = 0x0101010101010101;
+        static constexpr uint64_t gather = 0x8040201008040201;
+
+        assert(pixels.size() >= high.size() * 8 && high.size() == low.size());
+        for (size_t i = 0; i < high.size(); i++) {
+            uint64_t word{};
+            std::memcpy(&word, pixels.data() + i * 8, sizeof(word));
+            high[i] = (((word >> 7) & lsbs) * gather) >> 56;
+            low[i] = (((word >> 6) & lsbs) * gather) >> 56;
+        }
+    }
+
+    /**
+     * Store grayscale image, if requested. Image is stored as the four levels shown
+     */
+    void store_gray(const Framebuffer &pixels) {
+        if (not options.render_store) {
+            return;
+        }
+
+        std::vector<uint8_t> levels(Panel::width * Panel::height);
+        for (uint32_t row = 0; row < Panel::height; row++) {
+            std::ranges::transform(pixels.row(row), begin(levels) + row * Panel::width,
+                                   [](uint8_t alpha) { return 3 - (alpha >> 6); });
+        }
+        pbm::write_gray(fmt::format("{}-{}.pgm", *options.render_store, screen_number),
+                        Panel::width, Panel::height, 3, levels);
+        screen_number += 1;
+    }
+
+    hwif::Hwif<Panel> &hwif;
+    PowerState power_state = PowerState::Off;
+
+    /* Waveform currently loaded into display, if any */
+    const waveform::Profile *loaded_waveform = nullptr;
+
+    /* Frame buffer, packed as the display wants it */
+    Framebuffer fb{Panel::width, Panel::height};
+
+    /* Framebuffer as last sent to display, empty until the first draw */
+    std::optional<Framebuffer> previous{};
 
-    /* Frame buffer. Note that each pixel is 1 bit, so each element is 8 pixels */
-    std::vector<uint8_t> fb = std::vector<uint8_t>(IMG_SIZE);
+    /* Limits for when partial refresh is used instead of full refresh */
+    static constexpr uint32_t merge_margin = 32;
+    static constexpr size_t max_regions = 4;
+    static constexpr uint32_t max_partial_percent = 50;
 
     const Options &options;
     const Logger log = options.get_logger(Logger::Facility::Display);
+    waveform::Scheduler<Panel> scheduler{options};
     uint32_t screen_number = 0;
+    std::future<void> pending_store{};
 };
@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fmt/chrono.h>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "pbm.hpp"
+#include "rect.hpp"
+
+namespace emulator {
+
+/**
+ * Emulation of the display controller. Decodes the stream of commands and data sent to it, keeps
+ * the image planes in memory, and models for how long the controller signals busy. Each refresh
+ * updates an emulated panel, holding how much ink each pixel shows from 0 (white) to 3 (black).
+ * Geometry is taken from `Panel`
+ */
+template <typename Panel> struct Controller {
+    Controller(const Options &options) : options(options) {
+        reset();
+    }
+
+    /**
+     * Hardware reset. All registers and image memory is lost, and deep sleep is left
+     */
+    void reset() {
+        log("Reset");
+        command = 0;
+        params.clear();
+        powered = false;
+        sleeping = false;
+        partial = false;
+        dual_spi = false;
+        window = whole_panel;
+        frame_time = default_frame_time;
+        luts = {};
+        std::ranges::fill(old_plane, 0);
+        std::ranges::fill(new_plane, 0);
+        busy_until = std::chrono::steady_clock::now();
+    }
+
+    /**
+     * Receive command byte, i.e. byte sent with data/command pin low
+     */
+    void receive_command(uint8_t cmd) {
+        if (sleeping) {
+            log("Ignoring command {:#04x} while in deep sleep", cmd);
+            return;
+        }
+        if (busy() && cmd != GetStatus) {
+            log("Command {:#04x} sent while busy", cmd);
+        }
+
+        command = cmd;
+        params.clear();
+        cursor = 0;
+        switch (cmd) {
+            case PowerOn:
+                powered = true;
+                busy_until = std::chrono::steady_clock::now() + power_on_time;
+                break;
+
+            case PowerOff:
+                powered = false;
+                busy_until = std::chrono::steady_clock::now() + power_off_time;
+                break;
+
+            case DisplayRefresh:
+                refresh();
+                break;
+
+            case PartialIn:
+                partial = true;
+                break;
+
+            case PartialOut:
+                partial = false;
+                break;
+        }
+    }
+
+    /**
+     * Receive data for the last command, i.e. bytes sent with data/command pin high, on `lanes`
+     * data lines. Image data on another number of lines than the controller is set up for would be
+     * garbled, so it is dropped
+     */
+    void receive_data(std::span<const uint8_t> bytes, uint8_t lanes = 1) {
+        if (sleeping) {
+            log("Ignoring {} bytes while in deep sleep", bytes.size());
+            return;
+        }
+
+        const bool image =
+            command == DisplayStartTransmission1 || command == DisplayStartTransmission2;
+        const uint8_t expected = image && dual_spi ? 2 : 1;
+        if (lanes != expected) {
+            log("Dropping {} bytes for command {:#04x} sent on {} lanes, expected {}",
+                bytes.size(), command, lanes, expected);
+            return;
+        }
+
+        switch (command) {
+            case DisplayStartTransmission1:
+                write_plane(old_plane, bytes);
+                return;
+
+            case DisplayStartTransmission2:
+                write_plane(new_plane, bytes);
+                return;
+        }
+
+        std::ranges::copy(bytes, std::back_inserter(params));
+        switch (command) {
+            case LutVcom:
+            case LutBlue:
+            case LutWhite:
+            case LutGray1:
+            case LutGray2:
+                if (params.size() == lut_size) {
+                    std::ranges::copy(params, begin(luts[command - LutVcom]));
+                }
+                break;
+
+            case PLLControl:
+                if (params.size() == 1) {
+                    frame_time = params[0] == 0x06 ? default_frame_time : frame_time;
+                    if (params[0] != 0x06) {
+                        log("Frame rate setting {:#04x} not emulated", params[0]);
+                    }
+                }
+                break;
+
+            case DualSPI:
+                if (params.size() == 1) {
+                    dual_spi = params[0] & dual_spi_enable;
+                }
+                break;
+
+            case PartialWindow:
+                if (params.size() == 9) {
+                    const uint32_t x = (params[0] << 8 | params[1]) & ~0x07u;
+                    const uint32_t x_end = (params[2] << 8 | params[3]) | 0x07u;
+                    const uint32_t y = params[4] << 8 | params[5];
+                    const uint32_t y_end = params[6] << 8 | params[7];
+                    window = Rect{
+                        .x = x,
+                        .y = y,
+                        .width = std::min(x_end + 1, Panel::width) - x,
+                        .height = std::min(y_end + 1, Panel::height) - y,
+                    };
+                }
+                break;
+
+            case DeepSleep:
+                if (params.size() == 1 && params[0] == 0xA5) {
+                    log("Entering deep sleep");
+                    sleeping = true;
+                    powered = false;
+                }
+                break;
+        }
+    }
+
+    /**
+     * Answer a read of `size` bytes following the last command. Status tells if busy and powered,
+     * and the panel is always at room temperature
+     */
+    std::vector<uint8_t> respond(size_t size) const {
+        std::vector<uint8_t> response(size);
+        if (response.empty()) {
+            return response;
+        }
+        switch (command) {
+            case GetStatus:
+                response[0] =
+                    (busy() ? 0 : Panel::status_idle) | (powered ? Panel::status_powered : 0);
+                break;
+
+            case Revision:
+                std::copy_n(begin(revision), std::min(size, revision.size()), begin(response));
+                break;
+
+            case TemperatureSensorCalibration:
+                response[0] = Panel::room_temperature;
+                break;
+
+            default:
+                log("Read of {} bytes after command {:#04x} not emulated", size, command);
+                break;
+        }
+        return response;
+    }
+
+    /**
+     * Check if busy is signalled
+     */
+    bool busy() const {
+        return std::chrono::steady_clock::now() < busy_until;
+    }
+
+    /**
+     * Wait until busy is no longer signalled. Returns false if still busy after `timeout`
+     */
+    bool wait_for_idle(std::chrono::milliseconds timeout) {
+        const auto now = std::chrono::steady_clock::now();
+        if (busy_until - now > timeout) {
+            std::this_thread::sleep_for(timeout);
+            return false;
+        }
+        std::this_thread::sleep_until(busy_until);
+        return true;
+    }
+
+    /**
+     * Image shown on emulated panel, as amount of ink per pixel
+     */
+    std::span<const uint8_t> panel() const {
+        return image;
+    }
+
+    uint32_t refreshes() const {
+        return refresh_count;
+    }
+
+  private:
+    /* Commands that are emulated */
+    enum : uint8_t {
+        PowerOff = 0x02,
+        PowerOn = 0x04,
+        DeepSleep = 0x07,
+        DisplayStartTransmission1 = 0x10,
+        DisplayRefresh = 0x12,
+        DisplayStartTransmission2 = 0x13,
+        DualSPI = 0x15,
+        LutVcom = 0x20,
+        LutBlue = 0x21,
+        LutWhite = 0x22,
+        LutGray1 = 0x23,
+        LutGray2 = 0x24,
+        PLLControl = 0x30,
+        TemperatureSensorCalibration = 0x40,
+        Revision = 0x70,
+        GetStatus = 0x71,
+        PartialWindow = 0x90,
+        PartialIn = 0x91,
+        PartialOut = 0x92,
+    };
+
+    static constexpr size_t lut_size = 42;
+    using Lut = std::array<uint8_t, lut_size>;
+
+    /* Timing of controller, frame time is at 50 Hz */
+    static constexpr std::chrono::microseconds default_frame_time{20000};
+    static constexpr std::chrono::milliseconds power_on_time{80};
+    static constexpr std::chrono::milliseconds power_off_time{20};
+
+    /* Dual SPI setting bit, enabling image data on two lines */
+    static constexpr uint8_t dual_spi_enable = 0x10;
+
+    /* Revision read back from controller */
+    static constexpr std::array<uint8_t, 3> revision{0x0a, 0x81, 0x79};
+
+    /**
+     * Write image data, either to whole plane or to partial window, continuing where the previous
+     * data for the same command ended
+     */
+    void write_plane(std::vector<uint8_t> &plane, std::span<const uint8_t> bytes) {
+        const Rect area = partial ? window : whole_panel;
+        const uint32_t row_bytes = area.width / 8;
+        for (uint8_t byte : bytes) {
+            const uint32_t row = area.y + cursor / row_bytes;
+            if (row >= area.bottom()) {
+                log("Dropping data outside of {}", area);
+                return;
+            }
+            plane[row * Panel::stride + area.x / 8 + cursor % row_bytes] = byte;
+            cursor += 1;
+        }
+    }
+
+    /**
+     * Count number of frames a look up table drives pixels for
+     */
+    static uint32_t frames(const Lut &lut) {
+        uint32_t count = 0;
+        for (size_t group = 0; group < lut_size; group += 6) {
+            count += (lut[group + 1] + lut[group + 2] + lut[group + 3] + lut[group + 4]) *
+                     lut[group + 5];
+        }
+        return count;
+    }
+
+    /**
+     * Find the last voltage a look up table drives a pixel with, which decides its final color in
+     * black and white mode. Returns nothing if the pixel is never driven
+     */
+    static std::optional<uint8_t> final_ink(const Lut &lut) {
+        std::optional<uint8_t> ink{};
+        for (size_t group = 0; group < lut_size; group += 6) {
+            for (uint32_t phase = 0; phase < 4; phase++) {
+                const uint32_t level = (lut[group] >> (6 - 2 * phase)) & 0x03;
+                if (lut[group + 1 + phase] == 0 || lut[group + 5] == 0) {
+                    continue;
+                }
+                if (level == 0x01) {
+                    ink = 3;
+                } else if (level == 0x02) {
+                    ink = 0;
+                }
+            }
+        }
+        return ink;
+    }
+
+    /**
+     * Update panel from image planes. Pixel tables are picked by old and new bit, where the old
+     * bit is most significant. If all four tables differ they give four levels of gray, otherwise
+     * the last voltage of the table decides if pixel ends up black, white, or unchanged
+     */
+    void refresh() {
+        using namespace std::chrono;
+
+        if (not powered) {
+            log("Refresh while powered off, panel unchanged");
+            return;
+        }
+
+        /* Tables in order of old and new bit: WW, WB, BW, BB */
+        const std::array<const Lut *, 4> tables{&luts[1], &luts[3], &luts[2], &luts[4]};
+        const bool gray = *tables[0] != *tables[1] && *tables[0] != *tables[2] &&
+                          *tables[0] != *tables[3] && *tables[1] != *tables[2] &&
+                          *tables[1] != *tables[3] && *tables[2] != *tables[3];
+        std::array<std::optional<uint8_t>, 4> ink{};
+        uint32_t longest = frames(luts[0]);
+        for (size_t i = 0; i < tables.size(); i++) {
+            ink[i] = gray ? std::optional<uint8_t>(i) : final_ink(*tables[i]);
+            longest = std::max(longest, frames(*tables[i]));
+        }
+
+        const Rect area = partial ? window : whole_panel;
+        for (uint32_t y = area.y; y < area.bottom(); y++) {
+            for (uint32_t x = area.x; x < area.right(); x++) {
+                const uint32_t offset = y * Panel::stride + x / 8;
+                const uint32_t bit = 7 - x % 8;
+                const uint32_t index = ((old_plane[offset] >> bit) & 1) << 1 |
+                                       ((new_plane[offset] >> bit) & 1);
+                if (ink[index]) {
+                    image[y * Panel::width + x] = *ink[index];
+                }
+            }
+        }
+
+        const auto duration = frame_time * longest;
+        busy_until = steady_clock::now() + duration;
+        log("Refreshing {}{} for {}", area, gray ? " in gray" : "",
+            duration_cast<milliseconds>(duration));
+
+        if (options.render_store) {
+            std::vector<uint8_t> shown(image.size());
+            std::ranges::transform(image, begin(shown), [](uint8_t ink) { return 3 - ink; });
+            pbm::write_gray(fmt::format("{}-panel-{}.pgm", *options.render_store, refresh_count),
+                            Panel::width, Panel::height, 3, shown);
+        }
+        refresh_count += 1;
+    }
+
+    const Options &options;
+    const Logger log = options.get_logger(Logger::Facility::Emulator);
+
+    static constexpr Rect whole_panel{
+        .x = 0, .y = 0, .width = Panel::width, .height = Panel::height};
+
+    /* Controller state */
+    uint8_t command{};
+    std::vector<uint8_t> params{};
+    uint32_t cursor{};
+    bool powered{};
+    bool sleeping{};
+    bool partial{};
+    bool dual_spi{};
+    Rect window{};
+    std::chrono::microseconds frame_time{default_frame_time};
+    std::array<Lut, 5> luts{};
+    std::chrono::steady_clock::time_point busy_until{};
+
+    /* Controller memory, and panel */
+    std::vector<uint8_t> old_plane = std::vector<uint8_t>(Panel::height * Panel::stride);
+    std::vector<uint8_t> new_plane = std::vector<uint8_t>(Panel::height * Panel::stride);
+    std::vector<uint8_t> image = std::vector<uint8_t>(Panel::width * Panel::height);
+    uint32_t refresh_count{};
+};
+
+} // namespace emulator
@@ -6,6 +6,7 @@
 #include <poll.h>
 #include <span>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -46,3 +47,37 @@ struct File {
     int fd;
     std::string filename;
 };
+
+/**
+ * Whole file mapped read only into memory, for as long as this is kept
+ */
+struct Mapping {
+    Mapping(const std::string &filename) : file(filename, O_RDONLY) {
+        struct stat info {};
+        if (fstat(file, &info) < 0) {
+            throw std::runtime_error(
+                fmt::format("Error reading size of {}: {}", filename, strerror(errno)));
+        }
+        size = info.st_size;
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("Error mapping {}: {}", filename, strerror(errno)));
+        }
+    }
+
+    ~Mapping() {
+        munmap(data, size);
+    }
+
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+
+    std::span<const uint8_t> bytes() const {
+        return {static_cast<const uint8_t *>(data), size};
+    }
+
+  private:
+    File file;
+    void *data{};
+    size_t size{};
+};
@@ -0,0 +1,12 @@
+#include "font.hpp"
+
+#if defined(EMBEDDED_FONT)
+/* Font file given at build time, placed between the symbols declared in font.hpp */
+asm(".section .rodata\n"
+    ".global embedded_font_start\n"
+    "embedded_font_start:\n"
+    ".incbin \"" EMBEDDED_FONT "\"\n"
+    ".global embedded_font_end\n"
+    "embedded_font_end:\n"
+    ".previous\n");
+#endif
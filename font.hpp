@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cairomm/fontface.h>
+#include <fmt/chrono.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "common.hpp"
+#include "embedded-font.hpp"
+#include "file.hpp"
+#include "utils.hpp"
+
+namespace font {
+
+#if defined(EMBEDDED_FONT)
+/* Font file embedded in the binary, between these two symbols, see font.cpp. It is named by
+ * embedded-font.hpp, which make generates from FONT */
+extern "C" const uint8_t embedded_font_start[];
+extern "C" const uint8_t embedded_font_end[];
+#endif
+
+/**
+ * FreeType face read from font file contents in memory, which is either mapped from a file owned
+ * by the face, or embedded in the binary. Nothing is looked up through fontconfig
+ */
+class Face {
+  public:
+    Face(std::span<const uint8_t> data, const std::string &name,
+         std::unique_ptr<Mapping> mapping = nullptr)
+        : mapping{std::move(mapping)} {
+        if (FT_Init_FreeType(&library) != 0) {
+            throw utils::runtime_error("Unable to initialise FreeType");
+        }
+        if (FT_New_Memory_Face(library, data.data(), data.size(), 0, &face) != 0) {
+            FT_Done_FreeType(library);
+            throw utils::runtime_error("Unable to load font {}", name);
+        }
+    }
+
+    ~Face() {
+        FT_Done_Face(face);
+        FT_Done_FreeType(library);
+    }
+
+    Face(const Face &) = delete;
+    Face &operator=(const Face &) = delete;
+
+    FT_Face get() const {
+        return face;
+    }
+
+  private:
+    std::unique_ptr<Mapping> mapping;
+    FT_Library library{};
+    FT_Face face{};
+};
+
+/* Key of the FreeType face attached to each Cairo face made from one */
+inline const cairo_user_data_key_t face_key{};
+
+/**
+ * Cairo face drawing with `face`. Cairo may use the FreeType face for as long as anything holds
+ * on to the Cairo face, its own caches included, so the FreeType face is handed over to be
+ * released along with it
+ */
+inline Cairo::RefPtr<Cairo::FontFace> to_cairo(std::unique_ptr<Face> face) {
+    const Cairo::RefPtr<Cairo::FtFontFace> font_face =
+        Cairo::FtFontFace::create(face->get(), FT_LOAD_DEFAULT);
+    if (cairo_font_face_set_user_data(font_face->cobj(), &face_key, face.get(), [](void *data) {
+            delete static_cast<Face *>(data);
+        }) != CAIRO_STATUS_SUCCESS) {
+        throw utils::runtime_error("Unable to hand font over to Cairo");
+    }
+    face.release();
+    return font_face;
+}
+
+/**
+ * Font face to draw text with. A non empty `path` is mapped into memory, otherwise the font
+ * embedded at build time is used. Only without either is fontconfig asked for a sans-serif font,
+ * which may scan all fonts installed before the first frame can be drawn. Faces loaded once are
+ * shared by all screens
+ */
+inline Cairo::RefPtr<Cairo::FontFace> load(const std::string &path, const Logger &log) {
+    using namespace std::chrono;
+
+    static std::map<std::string, Cairo::RefPtr<Cairo::FontFace>> loaded{};
+    if (const auto found = loaded.find(path); found != loaded.end()) {
+        return found->second;
+    }
+
+    const auto start = steady_clock::now();
+    std::unique_ptr<Face> face{};
+    if (!path.empty()) {
+        auto mapping = std::make_unique<Mapping>(path);
+        const std::span<const uint8_t> data = mapping->bytes();
+        face = std::make_unique<Face>(data, path, std::move(mapping));
+    } else {
+#if defined(EMBEDDED_FONT)
+        face = std::make_unique<Face>(std::span(embedded_font_start, embedded_font_end),
+                                      "embedded in binary");
+#else
+        log("No font file given, leaving it to fontconfig");
+        return Cairo::ToyFontFace::create("cairo:sans-serif", Cairo::FONT_SLANT_NORMAL,
+                                          Cairo::FONT_WEIGHT_NORMAL);
+#endif
+    }
+    const char *family = face->get()->family_name;
+    log("Loaded font {} from {} in {}", family ? family : "without name",
+        path.empty() ? "binary" : path,
+        duration_cast<microseconds>(steady_clock::now() - start));
+
+    return loaded.emplace(path, to_cairo(std::move(face))).first->second;
+}
+
+} // namespace font
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "utils.hpp"
+
+/**
+ * Image with `bits` bits per pixel, where each row starts `stride` bytes after the previous. Rows
+ * may be padded beyond what their pixels need, as Cairo pads them to whole words
+ */
+struct Framebuffer {
+    /**
+     * Blank image with rows packed back to back
+     */
+    Framebuffer(uint32_t width, uint32_t height, uint32_t bits = 1)
+        : width{width}
+        , height{height}
+        , bits{bits}
+        , stride{row_size(width, bits)}
+        , data(static_cast<size_t>(height) * stride) {
+    }
+
+    /**
+     * Copy of an image laid out with `stride` bytes per row
+     */
+    Framebuffer(uint32_t width, uint32_t height, uint32_t bits, uint32_t stride,
+                std::span<const uint8_t> pixels)
+        : width{width}
+        , height{height}
+        , bits{bits}
+        , stride{stride}
+        , data(pixels.begin(), pixels.begin() + static_cast<size_t>(height) * stride) {
+        assert(stride >= row_size(width, bits));
+    }
+
+    /**
+     * Bytes holding the pixels of row `y`, without padding
+     */
+    std::span<const uint8_t> row(uint32_t y) const {
+        return std::span(data).subspan(static_cast<size_t>(y) * stride, row_size(width, bits));
+    }
+
+    std::span<uint8_t> row(uint32_t y) {
+        return std::span(data).subspan(static_cast<size_t>(y) * stride, row_size(width, bits));
+    }
+
+    /**
+     * All bytes of the image, including any padding
+     */
+    std::span<const uint8_t> bytes() const {
+        return data;
+    }
+
+    bool same_shape(const Framebuffer &other) const {
+        return width == other.width && height == other.height && bits == other.bits;
+    }
+
+    static constexpr uint32_t row_size(uint32_t width, uint32_t bits) {
+        return utils::div_ceil<uint32_t>(width * bits, 8);
+    }
+
+    uint32_t width;
+    uint32_t height;
+    uint32_t bits;
+    uint32_t stride;
+
+  private:
+    std::vector<uint8_t> data;
+};
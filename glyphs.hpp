@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cairomm/context.h>
+#include <cairomm/surface.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "rect.hpp"
+
+namespace glyphs {
+
+/* Cairo packs A1 surfaces into words of the native byte order, which only leaves the first pixel
+ * in the least significant bit of each byte on little endian hosts */
+static_assert(std::endian::native == std::endian::little);
+
+/**
+ * Pixels of an A1 surface, with the first pixel of each byte in its least significant bit. Only
+ * pixels within `bounds` are drawn on
+ */
+struct Canvas {
+    std::span<uint8_t> data;
+    uint32_t stride;
+    Rect bounds;
+};
+
+/**
+ * Glyph rasterised with one bit per pixel, packed like a `Canvas`. The bitmap is placed `left` and
+ * `top` pixels from the pen position on the baseline
+ */
+struct Glyph {
+    int32_t left;
+    int32_t top;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    double advance;
+    std::vector<uint8_t> bits;
+};
+
+/**
+ * Take the next character of UTF-8 encoded `text`
+ */
+inline char32_t next_character(std::string_view &text) {
+    const auto lead = static_cast<uint8_t>(text[0]);
+    const size_t length = std::min<size_t>(
+        lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4, text.size());
+    char32_t character = length == 1 ? lead : lead & (0x7f >> length);
+    for (size_t i = 1; i < length; i++) {
+        character = character << 6 | (static_cast<uint8_t>(text[i]) & 0x3f);
+    }
+    text.remove_prefix(length);
+    return character;
+}
+
+/**
+ * Glyphs of one scaled font, rasterised once so that text can be drawn by copying bits instead of
+ * having Cairo rasterise it for every render. Pens are placed on whole pixels, which is where
+ * Cairo places glyphs of A1 surfaces too
+ */
+class Atlas {
+  public:
+    /**
+     * Rasterise each of the UTF-8 encoded `characters` with `font`
+     */
+    Atlas(const Cairo::RefPtr<Cairo::ScaledFont> &font, std::string_view characters) {
+        while (!characters.empty()) {
+            const std::string_view rest = characters;
+            const char32_t character = next_character(characters);
+            const std::string utf8{rest.substr(0, rest.size() - characters.size())};
+            glyphs.try_emplace(character, rasterise(font, utf8));
+        }
+    }
+
+    /**
+     * Draw `text` onto `canvas` with the pen starting at `x` on baseline `y`. Nothing is drawn,
+     * and false returned, unless the atlas holds all glyphs of the text and it fits in bounds
+     */
+    bool draw(const Canvas &canvas, double x, double y, std::string_view text) const {
+        const int32_t baseline = std::lround(y);
+
+        /* Check all glyphs before drawing any, so text is never left half drawn */
+        double pen = x;
+        for (std::string_view rest = text; !rest.empty();) {
+            const auto found = glyphs.find(next_character(rest));
+            if (found == glyphs.end()) {
+                return false;
+            }
+            const Glyph &glyph = found->second;
+            const int64_t left = std::lround(pen) + glyph.left;
+            const int64_t top = baseline + glyph.top;
+            const Rect &bounds = canvas.bounds;
+            if (glyph.width > 0 &&
+                (left < bounds.x || top < bounds.y || left + glyph.width > bounds.right() ||
+                 top + glyph.height > bounds.bottom())) {
+                return false;
+            }
+            pen += glyph.advance;
+        }
+
+        pen = x;
+        for (std::string_view rest = text; !rest.empty();) {
+            const Glyph &glyph = glyphs.at(next_character(rest));
+            blit(canvas, glyph, std::lround(pen) + glyph.left, baseline + glyph.top);
+            pen += glyph.advance;
+        }
+        return true;
+    }
+
+  private:
+    /**
+     * Draw `utf8` on a surface of its own, just large enough to hold it, and keep its bits
+     */
+    static Glyph rasterise(const Cairo::RefPtr<Cairo::ScaledFont> &font, const std::string &utf8) {
+        const auto measure = Cairo::Context::create(
+            Cairo::ImageSurface::create(Cairo::Format::FORMAT_A1, 1, 1));
+        measure->set_scaled_font(font);
+        Cairo::TextExtents extents{};
+        measure->get_text_extents(utf8, extents);
+
+        const auto left = static_cast<int32_t>(std::floor(extents.x_bearing));
+        const auto top = static_cast<int32_t>(std::floor(extents.y_bearing));
+        const auto right = static_cast<int32_t>(std::ceil(extents.x_bearing + extents.width));
+        const auto bottom = static_cast<int32_t>(std::ceil(extents.y_bearing + extents.height));
+        Glyph glyph{
+            .left = left,
+            .top = top,
+            .width = static_cast<uint32_t>(std::max(right - left, 0)),
+            .height = static_cast<uint32_t>(std::max(bottom - top, 0)),
+            .stride = 0,
+            .advance = extents.x_advance,
+            .bits = {},
+        };
+        if (glyph.width == 0 || glyph.height == 0) {
+            glyph.width = 0;
+            glyph.height = 0;
+            return glyph;
+        }
+
+        const auto surface =
+            Cairo::ImageSurface::create(Cairo::Format::FORMAT_A1, glyph.width, glyph.height);
+        const auto context = Cairo::Context::create(surface);
+        context->set_scaled_font(font);
+        context->move_to(-left, -top);
+        context->show_text(utf8);
+        surface->flush();
+
+        glyph.stride = (glyph.width + 7) / 8;
+        glyph.bits.resize(static_cast<size_t>(glyph.height) * glyph.stride);
+        for (uint32_t row = 0; row < glyph.height; row++) {
+            const uint8_t *source = surface->get_data() + row * surface->get_stride();
+            std::copy_n(source, glyph.stride, glyph.bits.begin() + row * glyph.stride);
+        }
+        return glyph;
+    }
+
+    /**
+     * Set the pixels of `glyph` with its top left corner at `x`, `y`, which must be in bounds.
+     * Rows are copied a byte at a time, shifted to where the glyph starts within the first byte
+     */
+    static void blit(const Canvas &canvas, const Glyph &glyph, int32_t x, int32_t y) {
+        const uint32_t shift = x % 8;
+        const uint32_t row_bytes = (canvas.bounds.right() + 7) / 8;
+        for (uint32_t row = 0; row < glyph.height; row++) {
+            const std::span<const uint8_t> source =
+                std::span(glyph.bits).subspan(row * glyph.stride, glyph.stride);
+            const std::span<uint8_t> target = canvas.data.subspan(
+                static_cast<size_t>(y + row) * canvas.stride + x / 8, row_bytes - x / 8);
+            for (uint32_t i = 0; i < source.size(); i++) {
+                target[i] |= source[i] << shift;
+                if (shift != 0 && i + 1 < target.size()) {
+                    target[i + 1] |= source[i] >> (8 - shift);
+                }
+            }
+        }
+    }
+
+    std::unordered_map<char32_t, Glyph> glyphs{};
+};
+
+} // namespace glyphs
@@ -2,15 +2,19 @@
 
 #include <algorithm>
 #include <cassert>
-#include <filesystem>
-#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
-#include <gpiod.hpp>
-#include <thread>
+#include <fmt/chrono.h>
+#include <gpiod.h>
 
 #include "common.hpp"
-#include "file.hpp"
 
 namespace gpio {
 
@@ -22,144 +26,304 @@ enum class Active : int {
     High = 1,
 };
 
-struct Output {
-    /**
-     * Create new GPIO output using `pin`. It will be considered active at given `level`.
-     * If options describe this as dry run, then no actual GPIO toggling will be made
-     */
-    Output(const Options &options, Active level, uint32_t pin, const std::string &name)
-        : level(level), options(options) {
+enum class Direction {
+    Input,
+    Output,
+};
+
+/**
+ * Line to request. Outputs are driven inactive when requested, inputs report both edges
+ */
+struct Line {
+    uint32_t pin;
+    Direction direction;
+    Active level = Active::High;
+};
+
+/**
+ * Level to set an output line to
+ */
+struct Level {
+    uint32_t pin;
+    bool active;
+};
+
+/**
+ * Edge seen on an input line
+ */
+struct Edge {
+    uint32_t pin;
+    bool rising;
+};
+
+/**
+ * GPIO chip, opened once for all lines requested from it. If options describe this as dry run,
+ * then the chip is never opened
+ */
+struct Chip {
+    Chip(const Options &options, const std::string &path = "/dev/gpiochip0") : options(options) {
         if (options.is_dry()) {
             return;
         }
 
-        chip = gpiod_chip_open("/dev/gpiochip0");
+        chip = gpiod_chip_open(path.c_str());
         if (!chip) {
-            throw std::runtime_error("Unable to open gpio chip for output");
+            throw std::runtime_error(fmt::format("Unable to open gpio chip {}", path));
         }
+    }
 
-        line = gpiod_chip_get_line(chip, pin);
-        if (!line) {
-            throw std::runtime_error("Unable to get line");
+    ~Chip() {
+        if (chip) {
+            gpiod_chip_close(chip);
         }
+    }
 
-        gpiod_line_request_config cfg{
-            .consumer = name.c_str(),
-            .request_type = GPIOD_LINE_REQUEST_DIRECTION_OUTPUT,
-            .flags = 0,
-        };
+    Chip(const Chip &) = delete;
+    Chip &operator=(const Chip &) = delete;
+
+  private:
+    friend struct Request;
 
-        if (gpiod_line_request(line, &cfg, 0) != 0) {
-            throw std::runtime_error("Unable to request output");
+    gpiod_chip *chip{};
+    const Options &options;
+};
+
+/**
+ * Set of lines requested together, using a single file descriptor. Any number of outputs can be
+ * set with one call, and outputs already at the wanted level are not written again
+ */
+struct Request {
+    Request(Chip &chip, const std::string &consumer, std::initializer_list<Line> lines)
+        : options(chip.options) {
+        for (const Line &line : lines) {
+            if (line.direction == Direction::Output) {
+                written[line.pin] = false;
+            }
+        }
+        if (options.is_dry()) {
+            return;
+        }
+
+        const auto line_config = owned(gpiod_line_config_new(), gpiod_line_config_free);
+        for (const Line &line : lines) {
+            const auto settings = owned(gpiod_line_settings_new(), gpiod_line_settings_free);
+            if (line.direction == Direction::Output) {
+                gpiod_line_settings_set_direction(settings.get(), GPIOD_LINE_DIRECTION_OUTPUT);
+                gpiod_line_settings_set_active_low(settings.get(), line.level == Active::Low);
+                gpiod_line_settings_set_output_value(settings.get(), GPIOD_LINE_VALUE_INACTIVE);
+            } else {
+                gpiod_line_settings_set_direction(settings.get(), GPIOD_LINE_DIRECTION_INPUT);
+                gpiod_line_settings_set_edge_detection(settings.get(), GPIOD_LINE_EDGE_BOTH);
+            }
+            const unsigned int offset = line.pin;
+            if (gpiod_line_config_add_line_settings(line_config.get(), &offset, 1,
+                                                    settings.get()) != 0) {
+                throw std::runtime_error(fmt::format("Unable to configure line {}", line.pin));
+            }
+        }
+
+        const auto request_config = owned(gpiod_request_config_new(), gpiod_request_config_free);
+        gpiod_request_config_set_consumer(request_config.get(), consumer.c_str());
+        request = gpiod_chip_request_lines(chip.chip, request_config.get(), line_config.get());
+        if (!request) {
+            throw std::runtime_error(fmt::format("Unable to request lines for {}", consumer));
+        }
+        events = gpiod_edge_event_buffer_new(1);
+        if (!events) {
+            throw std::runtime_error("Unable to allocate edge event buffer");
         }
     }
 
-    ~Output() {
-        if (line) {
-            gpiod_line_release(line);
+    ~Request() {
+        if (events) {
+            gpiod_edge_event_buffer_free(events);
         }
-        if (chip) {
-            gpiod_chip_close(chip);
+        if (request) {
+            gpiod_line_request_release(request);
         }
     }
 
+    Request(const Request &) = delete;
+    Request &operator=(const Request &) = delete;
+
     /**
-     * Set pin to active state, as per `active` level given at construction
+     * Set outputs to given levels, all in a single call
      */
-    void activate() {
-        int value = static_cast<int>(level);
-        if (options.is_dry()) {
+    void set(std::initializer_list<Level> levels) {
+        std::vector<unsigned int> offsets{};
+        std::vector<gpiod_line_value> values{};
+        for (const Level &level : levels) {
+            assert(written.contains(level.pin));
+            bool &current = written[level.pin];
+            if (current != level.active) {
+                current = level.active;
+                offsets.push_back(level.pin);
+                values.push_back(level.active ? GPIOD_LINE_VALUE_ACTIVE
+                                              : GPIOD_LINE_VALUE_INACTIVE);
+            }
+        }
+        if (offsets.empty() || options.is_dry()) {
             return;
         }
 
-        if (gpiod_line_set_value(line, value) != 0) {
-            throw std::runtime_error("Unable to activate pin");
+        if (gpiod_line_request_set_values_subset(request, offsets.size(), offsets.data(),
+                                                 values.data()) != 0) {
+            throw std::runtime_error("Unable to set output lines");
         }
     }
 
     /**
-     * Set pin to deactive state, as per `active` level given at construction
+     * Read raw level of an input, true when high
      */
-    void deactive() {
-        int value = !static_cast<int>(level);
+    bool get(uint32_t pin) {
         if (options.is_dry()) {
-            return;
+            return true;
         }
 
-        if (gpiod_line_set_value(line, value) != 0) {
-            throw std::runtime_error("Unable to deactivate pin");
+        const gpiod_line_value value = gpiod_line_request_get_value(request, pin);
+        if (value == GPIOD_LINE_VALUE_ERROR) {
+            throw std::runtime_error(fmt::format("Unable to read line {}", pin));
         }
+        return value == GPIOD_LINE_VALUE_ACTIVE;
     }
 
-  private:
-    gpiod_chip *chip{};
-    gpiod_line *line{};
-
-    Active level;
-    const Options &options;
-    Logger log = options.get_logger(Logger::Facility::Gpio);
-};
-
-struct Input {
     /**
-     * Create new GPIO input using `pin`. If options describe this as dry run,
-     * then no actual GPIO toggling will be made
+     * Wait for next edge on any input, returns nothing if none is seen within `timeout`
      */
-    Input(const Options &options, uint32_t pin, const std::string &name) : options(options) {
+    std::optional<Edge> wait_edge(std::chrono::nanoseconds timeout) {
         if (options.is_dry()) {
-            return;
+            return std::nullopt;
         }
 
-        chip = gpiod_chip_open("/dev/gpiochip0");
-        if (!chip) {
-            throw std::runtime_error("Error opening chip for input");
+        const int status = gpiod_line_request_wait_edge_events(request, timeout.count());
+        if (status < 0) {
+            throw std::runtime_error("Unable to wait for line event");
+        } else if (status == 0) {
+            return std::nullopt;
         }
 
-        line = gpiod_chip_get_line(chip, pin);
-        if (!line) {
-            throw std::runtime_error("Error opening line");
+        if (gpiod_line_request_read_edge_events(request, events, 1) != 1) {
+            throw std::runtime_error("Unable to read line event");
         }
-
-        gpiod_line_request_config cfg{
-            .consumer = name.c_str(),
-            .request_type = gpiod::line_request::DIRECTION_INPUT,
-            .flags = 0,
+        gpiod_edge_event *event = gpiod_edge_event_buffer_get_event(events, 0);
+        return Edge{
+            .pin = gpiod_edge_event_get_line_offset(event),
+            .rising = gpiod_edge_event_get_event_type(event) == GPIOD_EDGE_EVENT_RISING_EDGE,
         };
+    }
 
-        if (gpiod_line_request(line, &cfg, 0) != 0) {
-            throw std::runtime_error("Unable to request line");
+  private:
+    template <typename T>
+    static std::unique_ptr<T, void (*)(T *)> owned(T *ptr, void (*free)(T *)) {
+        if (!ptr) {
+            throw std::runtime_error("Unable to allocate gpio configuration");
         }
+        return {ptr, free};
     }
 
-    ~Input() {
-        if (line) {
-            gpiod_line_release(line);
-        }
-        if (chip) {
-            gpiod_chip_close(chip);
+    gpiod_line_request *request{};
+    gpiod_edge_event_buffer *events{};
+
+    /* Last level written to each output */
+    std::map<uint32_t, bool> written{};
+
+    const Options &options;
+};
+
+struct Output {
+    /**
+     * Output `pin` of `request`. It is considered active at the level it was requested with
+     */
+    Output(Request &request, uint32_t pin) : request(request), pin(pin) {
+    }
+
+    /**
+     * Set pin to active state
+     */
+    void activate() {
+        request.set({{.pin = pin, .active = true}});
+    }
+
+    /**
+     * Set pin to deactive state
+     */
+    void deactive() {
+        request.set({{.pin = pin, .active = false}});
+    }
+
+  private:
+    Request &request;
+    uint32_t pin;
+};
+
+struct Input {
+    /**
+     * Input `pin` of `request`. If options describe this as dry run, then the line is never
+     * waited on
+     */
+    Input(const Options &options, Request &request, uint32_t pin)
+        : request(request), pin(pin), options(options) {
+    }
+
+    /**
+     * Discard edges seen so far, so that the next `wfi` only considers edges after this call
+     */
+    void arm() {
+        while (request.wait_edge(std::chrono::nanoseconds{0})) {
         }
     }
 
-    void wfi() {
-        using namespace std::literals::chrono_literals;
+    /**
+     * Wait for line to be released, i.e. for a rising edge. The line is considered to be held
+     * low once a falling edge is seen, or if it reads low when called. If the line is never
+     * pulled low within `assert_window` it is assumed to already have been released. Returns
+     * false if line is still held low after `timeout`
+     */
+    bool wfi(std::chrono::milliseconds timeout) {
+        using namespace std::chrono;
 
         log("Awaiting interrupt");
         if (options.is_dry()) {
-            return;
+            return true;
         }
 
-        int sleep_count = 0;
-        do {
-            std::this_thread::sleep_for(5ms);
-            sleep_count += 1;
-        } while (!gpiod_line_get_value(line));
-        log("Slept for {} iterations", sleep_count);
-        std::this_thread::sleep_for(5ms);
+        const auto start = steady_clock::now();
+        const auto deadline = start + timeout;
+        bool asserted = !request.get(pin);
+        while (true) {
+            const auto limit = asserted ? deadline : std::min(deadline, start + assert_window);
+            const auto remaining =
+                std::max(duration_cast<nanoseconds>(limit - steady_clock::now()), 0ns);
+
+            const std::optional<Edge> edge = request.wait_edge(remaining);
+            if (!edge) {
+                if (not asserted) {
+                    log("Line was never pulled low");
+                    return true;
+                }
+                log("Line still low after {}", timeout);
+                return false;
+            }
+            if (edge->pin != pin) {
+                continue;
+            }
+
+            if (!edge->rising) {
+                asserted = true;
+            } else {
+                log("Line released after {}",
+                    duration_cast<milliseconds>(steady_clock::now() - start));
+                return true;
+            }
+        }
     }
 
   private:
-    gpiod_chip *chip{};
-    gpiod_line *line{};
+    /* How long the line may take to be pulled low, after what should make it low */
+    static constexpr std::chrono::milliseconds assert_window{100};
+
+    Request &request;
+    uint32_t pin;
     const Options &options;
     const Logger log = options.get_logger(Logger::Facility::Gpio);
 };
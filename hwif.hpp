@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <chrono>
+#include <fmt/chrono.h>
+#include <fstream>
 #include <fmt/ranges.h>
 #include <linux/spi/spidev.h>
 #include <linux/types.h>
@@ -13,11 +18,43 @@
 #include <vector>
 
 #include "common.hpp"
+#include "emulator.hpp"
+#include "file.hpp"
 #include "gpio.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 namespace hwif {
 
+/**
+ * Pins a panel is wired to, as given by `options`. All of them are requested together from a
+ * single chip, so reset and control can be set with one call. Panels sharing a chip need lines of
+ * their own
+ */
 struct Pins {
+    Pins(const Options &options)
+        : reset_pin{options.wiring.reset_pin}
+        , control_pin{options.wiring.control_pin}
+        , busy_pin{options.wiring.busy_pin}
+        , chip{options}
+        , request{chip,
+                  "eink",
+                  {
+                      gpio::Line{reset_pin, gpio::Direction::Output, gpio::Active::Low},
+                      gpio::Line{control_pin, gpio::Direction::Output, gpio::Active::Low},
+                      gpio::Line{busy_pin, gpio::Direction::Input},
+                  }}
+        , reset{request, reset_pin}
+        , control{request, control_pin}
+        , busy{options, request, busy_pin} {
+    }
+
+    const uint32_t reset_pin;
+    const uint32_t control_pin;
+    const uint32_t busy_pin;
+
+    gpio::Chip chip;
+    gpio::Request request;
     gpio::Output reset;
     gpio::Output control;
     gpio::Input busy;
@@ -75,10 +112,41 @@ enum class Command : uint8_t {
 
 };
 
-struct Hwif {
+/* Length byte marking a step in a script as one waiting for busy, instead of carrying data */
+inline constexpr uint8_t wait_step = 0xff;
+
+/**
+ * Step of a command script, sending `cmd` along with `data`
+ */
+template <typename... Data>
+constexpr std::array<uint8_t, 2 + sizeof...(Data)> step(Command cmd, Data... data) {
+    static_assert(sizeof...(Data) < wait_step);
+    return {static_cast<uint8_t>(cmd), static_cast<uint8_t>(sizeof...(Data)),
+            static_cast<uint8_t>(data)...};
+}
+
+/**
+ * Step of a command script, sending `cmd` and waiting for the display to carry it out
+ */
+constexpr std::array<uint8_t, 2> step_and_wait(Command cmd) {
+    return {static_cast<uint8_t>(cmd), wait_step};
+}
+
+/**
+ * Join steps into a script, held in a single buffer
+ */
+template <size_t... N> constexpr auto script(const std::array<uint8_t, N> &...steps) {
+    std::array<uint8_t, (N + ...)> result{};
+    auto out = result.begin();
+    ((out = std::ranges::copy(steps, out).out), ...);
+    return result;
+}
+
+template <typename Panel> struct Hwif {
     Hwif(const Options &options, Pins &pins) : pins(pins), options(options) {
-        fd = options.is_dry() ? nullptr
-                              : std::make_unique<File>(options.spi_device, O_RDWR | O_SYNC);
+        fd = options.is_dry()
+                 ? nullptr
+                 : std::make_unique<File>(options.wiring.spi_device, O_RDWR | O_SYNC);
         if (options.is_dry()) {
             return;
         }
@@ -89,13 +157,12 @@ struct Hwif {
         set_mode(SPI_MODE_0);
         set_chip_select(ChipSelect::Low);
         set_speed(10000000);
+        if (options.dual_spi) {
+            enable_dual_lanes();
+        }
     }
 
-    template <typename T> void send(Command cmd, T data) {
-        send(static_cast<uint8_t>(cmd), data);
-    }
-
-    void send(Command cmd, std::span<uint8_t> data) {
+    void send(Command cmd, std::span<const uint8_t> data) {
         send(static_cast<uint8_t>(cmd), data);
     }
 
@@ -111,19 +178,105 @@ struct Hwif {
         log("Resetting screen");
 
         using namespace std::literals::chrono_literals;
-        pins.reset.deactive();
+        /* Control is left inactive while the controller is reset */
+        pins.request.set({
+            {.pin = pins.reset_pin, .active = false},
+            {.pin = pins.control_pin, .active = false},
+        });
+        record_pin(trace::Pin::Reset, false);
         std::this_thread::sleep_for(20ms);
         pins.reset.activate();
+        record_pin(trace::Pin::Reset, true);
         std::this_thread::sleep_for(2ms);
         pins.reset.deactive();
+        record_pin(trace::Pin::Reset, false);
         std::this_thread::sleep_for(20ms);
+
+        if (emulator) {
+            emulator->reset();
+        }
     }
 
-    void wait_for_idle() {
-        if (options.is_dry()) {
-            return;
+    /**
+     * Send command, and wait for the display to signal that it has been carried out
+     */
+    void send_and_wait(Command cmd, std::chrono::milliseconds timeout) {
+        pins.busy.arm();
+        send(cmd);
+        wait_for_idle(timeout);
+    }
+
+    /**
+     * Run a script made by `script`, each wait lasting at most `timeout`
+     */
+    void send_script(std::span<const uint8_t> steps, std::chrono::milliseconds timeout) {
+        while (!steps.empty()) {
+            assert(steps.size() >= 2);
+            const auto cmd = static_cast<Command>(steps[0]);
+            const uint8_t length = steps[1];
+            if (length == wait_step) {
+                send_and_wait(cmd, timeout);
+                steps = steps.subspan(2);
+            } else if (length == 0) {
+                send(cmd);
+                steps = steps.subspan(2);
+            } else {
+                send(cmd, steps.subspan(2, length));
+                steps = steps.subspan(2 + length);
+            }
+        }
+    }
+
+    void wait_for_idle(std::chrono::milliseconds timeout) {
+        using namespace std::chrono;
+        const auto start = steady_clock::now();
+        wait_on_busy(timeout);
+        const auto waited = duration_cast<microseconds>(steady_clock::now() - start);
+        counters.wait(last_command, waited);
+        if (recorder) {
+            recorder->wait(timeout, waited);
         }
-        pins.busy.wfi();
+    }
+
+    /**
+     * Send command, and read `size` bytes of response. The controller answers on the data line it
+     * receives on, so the bus is switched to three wire mode for the read. Dry runs get synthetic
+     * responses, from the emulated controller if there is one
+     */
+    std::vector<uint8_t> read(Command cmd, size_t size) {
+        using namespace std::chrono;
+        const auto start = steady_clock::now();
+        size_t syscalls = send_command(static_cast<uint8_t>(cmd));
+
+        std::vector<uint8_t> response(size);
+        if (emulator) {
+            response = emulator->respond(size);
+        } else if (options.is_dry()) {
+            synthetic_response(cmd, response);
+        } else {
+            set_bus_mode(BusMode::ThreeWire);
+            syscalls += receive(response.data(), response.size());
+            set_bus_mode(BusMode::FourWire);
+            syscalls += 2;
+        }
+        log("read {} bytes: {}", size, response);
+        counters.command(static_cast<uint8_t>(cmd), 1 + size, syscalls,
+                         duration_cast<microseconds>(steady_clock::now() - start));
+        return response;
+    }
+
+    /**
+     * Ask the controller whether it is busy, rather than looking at the busy pin
+     */
+    bool idle() {
+        return read(Command::GetStatus, 1)[0] & Panel::status_idle;
+    }
+
+    /**
+     * Bytes, syscalls and time spent on each command
+     */
+    stats::Registry &stats() {
+        return counters;
     }
 
   private:
@@ -142,52 +295,178 @@ struct Hwif {
         FourWire,
     };
 
+    void wait_on_busy(std::chrono::milliseconds timeout) {
+        if (emulator) {
+            if (not emulator->wait_for_idle(timeout)) {
+                throw utils::runtime_error("Emulated display still busy after {}", timeout);
+            }
+            return;
+        }
+        if (options.is_dry()) {
+            return;
+        }
+        if (not pins.busy.wfi(timeout)) {
+            /* An edge on the busy pin may have been missed, the controller knows for sure */
+            if (idle()) {
+                log("Busy pin still asserted after {}, but controller is idle", timeout);
+                return;
+            }
+            throw utils::runtime_error("Display still busy after {}", timeout);
+        }
+    }
+
+    /**
+     * Fill in response of a controller that is idle and powered, at room temperature
+     */
+    static void synthetic_response(Command cmd, std::span<uint8_t> response) {
+        std::ranges::fill(response, 0);
+        if (response.empty()) {
+            return;
+        }
+        switch (cmd) {
+            case Command::GetStatus:
+                response[0] = Panel::status_idle | Panel::status_powered;
+                break;
+            case Command::TemperatureSensorCalibration:
+                response[0] = Panel::room_temperature;
+                break;
+            default:
+                break;
+        }
+    }
+
     /**
      * Send command followed by data
      */
-    void send(uint8_t cmd, std::span<uint8_t> data) {
-        send(cmd);
-        transfer(data.data(), data.size());
+    void send(uint8_t cmd, std::span<const uint8_t> data) {
+        using namespace std::chrono;
+        const auto start = steady_clock::now();
+        const uint8_t lanes = data_lanes(cmd);
+        const size_t syscalls = send_command(cmd) + transfer(data.data(), data.size(), lanes);
+        counters.command(cmd, 1 + data.size(), syscalls,
+                         duration_cast<microseconds>(steady_clock::now() - start));
+        if (recorder) {
+            recorder->data(data);
+        }
+        if (emulator) {
+            emulator->receive_data(data, lanes);
+        }
     }
 
     /**
      * Send command followed by data
      */
     void send(uint8_t cmd, std::initializer_list<uint8_t> data) {
-        send(cmd);
-        transfer(data.begin(), data.size());
+        send(cmd, std::span(data.begin(), data.size()));
     }
 
     /**
      * Send command
      */
     void send(uint8_t cmd) {
+        using namespace std::chrono;
+        const auto start = steady_clock::now();
+        const size_t syscalls = send_command(cmd);
+        counters.command(cmd, 1, syscalls,
+                         duration_cast<microseconds>(steady_clock::now() - start));
+    }
+
+    /**
+     * Send command byte with control pin active, returns number of syscalls used
+     */
+    size_t send_command(uint8_t cmd) {
+        last_command = cmd;
         pins.control.activate();
-        transfer(&cmd, 1);
+        record_pin(trace::Pin::Control, true);
+        const size_t syscalls = transfer(&cmd, 1);
+        if (recorder) {
+            recorder->command(cmd);
+        }
         pins.control.deactive();
+        record_pin(trace::Pin::Control, false);
+        if (emulator) {
+            emulator->receive_command(cmd);
+        }
+        return syscalls;
+    }
+
+    void record_pin(trace::Pin pin, bool active) {
+        if (recorder) {
+            recorder->pin(pin, active);
+        }
+    }
+
+    /**
+     * Read data over SPI, as a single message. Returns number of syscalls used
+     */
+    size_t receive(uint8_t *data, size_t size) {
+        assert(size <= chunk_size);
+        spi_ioc_transfer xfer{};
+        xfer.rx_buf = reinterpret_cast<uintptr_t>(data);
+        xfer.len = static_cast<uint32_t>(size);
+        xfer.speed_hz = speed;
+        xfer.bits_per_word = 8;
+        if (ioctl(*fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+            throw std::runtime_error(
+                fmt::format("Unable to read data from SPI: {}", strerror(errno)));
+        }
+        return 1;
+    }
+
+    /**
+     * Number of data lines used for data of `cmd`. Only image data is sent on two lines in dual SPI
+     * mode, commands and their parameters are always sent on one
+     */
+    uint8_t data_lanes(uint8_t cmd) const {
+        const bool image = cmd == static_cast<uint8_t>(Command::DisplayStartTransmission1) ||
+                           cmd == static_cast<uint8_t>(Command::DisplayStartTransmission2);
+        return options.dual_spi && image ? 2 : 1;
     }
 
     /**
-     * Transfer data over SPI by sending it as chunks
+     * Transfer data over SPI by sending it as chunks, on `lanes` data lines. Each chunk is handed
+     * to spidev as a single message, as spidev refuses messages larger than its bounce buffer.
+     * Returns number of syscalls used
      */
-    void transfer(const uint8_t *data, size_t size) {
-        std::vector<uint8_t> buffer(data, data + size);
-        log("writing {} bytes: {}", size, buffer | std::views::take(16));
+    size_t transfer(const uint8_t *data, size_t size, uint8_t lanes = 1) {
+        log("writing {} bytes on {} lanes: {}", size, lanes,
+            std::span(data, size) | std::views::take(16));
 
         if (options.is_dry()) {
-            return;
+            return 0;
         }
 
-        static constexpr size_t chunk_size = 64;
+        size_t syscalls = 0;
         size_t written = 0;
         while (written < size) {
             size_t win = std::min(size - written, chunk_size);
-            if (write(*fd, buffer.data() + written, win) < 0) {
+            spi_ioc_transfer xfer{};
+            xfer.tx_buf = reinterpret_cast<uintptr_t>(data + written);
+            xfer.len = static_cast<uint32_t>(win);
+            xfer.speed_hz = speed;
+            xfer.bits_per_word = 8;
+            xfer.tx_nbits = lanes;
+            if (ioctl(*fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
                 throw std::runtime_error(
                     fmt::format("Unable to write data to SPI: {}", strerror(errno)));
             }
             written += win;
+            syscalls += 1;
+        }
+        return syscalls;
+    }
+
+    /**
+     * Read size of spidev bounce buffer, which limits how much can be sent in one message
+     */
+    static size_t read_buffer_size() {
+        static constexpr size_t default_size = 4096;
+        std::ifstream param{"/sys/module/spidev/parameters/bufsiz"};
+        size_t size = 0;
+        if (param >> size && size > 0) {
+            return size;
         }
+        return default_size;
     }
 
     /**
@@ -198,6 +477,7 @@ struct Hwif {
             return;
         }
 
+        this->speed = speed;
         if (ioctl(*fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
             throw std::runtime_error(fmt::format("Unable to set write speed: {}", strerror(errno)));
         }
@@ -230,13 +510,30 @@ struct Hwif {
             return;
         }
 
-        m_mode &= 0xFC;
+        m_mode &= ~SPI_MODE_3;
         m_mode |= mode;
-        if (ioctl(*fd, SPI_IOC_WR_MODE, &m_mode) < 0) {
+        if (ioctl(*fd, SPI_IOC_WR_MODE32, &m_mode) < 0) {
             throw std::runtime_error(fmt::format("Unable to set hwif mode: {}", strerror(errno)));
         }
     }
 
+    /**
+     * Allow transfers on two data lines, which fails unless the SPI controller supports dual
+     * transfers. Mode flags beyond the first eight bits can only be set with the 32 bit mode
+     * request, and the 8 bit request would clear them, so all mode changes use the 32 bit one
+     */
+    void enable_dual_lanes() {
+        if (options.is_dry()) {
+            return;
+        }
+
+        m_mode |= SPI_TX_DUAL;
+        if (ioctl(*fd, SPI_IOC_WR_MODE32, &m_mode) < 0) {
+            throw std::runtime_error(
+                fmt::format("Unable to enable dual SPI transfers: {}", strerror(errno)));
+        }
+    }
+
     void set_chip_select(ChipSelect mode) {
         if (options.is_dry()) {
             return;
@@ -254,7 +551,7 @@ struct Hwif {
                 break;
             }
         }
-        if (ioctl(*fd, SPI_IOC_WR_MODE, &m_mode) < 0) {
+        if (ioctl(*fd, SPI_IOC_WR_MODE32, &m_mode) < 0) {
             throw std::runtime_error(fmt::format("Unable to set hwif cs: {}", strerror(errno)));
         }
     }
@@ -264,15 +561,21 @@ struct Hwif {
             return;
         }
 
+        /* The SPI core refuses dual transfers on a three wire bus, so they are left off while
+         * reading */
         switch (mode) {
             case BusMode::ThreeWire:
                 m_mode |= SPI_3WIRE;
+                m_mode &= ~SPI_TX_DUAL;
                 break;
             case BusMode::FourWire:
                 m_mode &= ~SPI_3WIRE;
+                if (options.dual_spi) {
+                    m_mode |= SPI_TX_DUAL;
+                }
                 break;
         }
-        if (ioctl(*fd, SPI_IOC_WR_MODE, &m_mode) < 0) {
+        if (ioctl(*fd, SPI_IOC_WR_MODE32, &m_mode) < 0) {
             throw std::runtime_error(
                 fmt::format("Unable to set hwif bus mode: {}", strerror(errno)));
         }
@@ -281,10 +584,20 @@ struct Hwif {
     Pins &pins;
 
     std::unique_ptr<File> fd;
-    uint16_t m_mode = 0;
+    uint32_t m_mode = 0;
+    uint32_t speed = 0;
+    size_t chunk_size = read_buffer_size();
+
+    stats::Registry counters{};
+    uint8_t last_command{};
 
     const Options &options;
     const Logger log = options.get_logger(Logger::Facility::Hwif);
+
+    std::unique_ptr<emulator::Controller<Panel>> emulator =
+        options.is_emulated() ? std::make_unique<emulator::Controller<Panel>>(options) : nullptr;
+    std::unique_ptr<trace::Recorder> recorder =
+        options.trace_store ? std::make_unique<trace::Recorder>(*options.trace_store) : nullptr;
 };
 
 } // namespace hwif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Where things are drawn on screen, in pixels of the rendering before it is turned to fit the
+ * panel. Defaults give the original layout, and each can be changed in the settings file
+ */
+struct Layout {
+    /* Font file to draw all text with, mapped into memory. When empty the font embedded at build
+     * time is used, and without one fontconfig is asked for a sans-serif font */
+    std::string font{};
+
+    /* Measured values, in a column left of the forecast */
+    double values_width = 192;
+    double font_large = 56;
+    double font_small = 32;
+    double font_tiny = 14;
+    double spacing = 5;
+    double indent_small = 10;
+    double indent_large = 40;
+    std::string indoor_label = "Inne";
+    std::string outdoor_label = "Ute";
+    std::string rain_label = "Regn (mm), 1h/24h";
+
+    /* Forecast graph, with temperatures annotated left of it, and rows of hours, wind, gusts and
+     * rain below it */
+    double forecast_left = 40;
+    double forecast_right = 10;
+    double graph_indent = 50;
+    double graph_top = 30;
+    double annotation_offset = 5;
+    double row_height = 30;
+    double row_bottom = 10;
+    double row_label_indent = 75;
+    double font_graph = 20;
+    double font_rows = 22;
+    double font_row_labels = 14;
+    std::string wind_label = "Vind, m/s";
+    std::string gusts_label = "Byar, m/s";
+    std::string rain_row_label = "Regn, mm";
+    uint32_t samples = 12;
+};
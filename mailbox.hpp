@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+
+/**
+ * Single slot mailbox, where a newer item replaces an item that has not yet been taken
+ */
+template <typename T> struct Mailbox {
+    /** Put item in mailbox. Returns true if this replaced an item that was never taken */
+    auto put(T item) -> bool {
+        std::unique_lock<std::mutex> lock{mutex};
+        const bool replaced = slot.has_value();
+        slot = std::move(item);
+        cond.notify_one();
+        return replaced;
+    }
+
+    /** Wait for an item. Returns nothing once mailbox is closed and emptied */
+    auto take() -> std::optional<T> {
+        std::unique_lock<std::mutex> lock{mutex};
+        cond.wait(lock, [this] { return slot.has_value() || closed; });
+        std::optional<T> item = std::move(slot);
+        slot.reset();
+        return item;
+    }
+
+    /** Close mailbox, an item already put can still be taken */
+    auto close() -> void {
+        std::unique_lock<std::mutex> lock{mutex};
+        closed = true;
+        cond.notify_all();
+    }
+
+  private:
+    std::optional<T> slot{};
+    bool closed{false};
+    std::mutex mutex{};
+    std::condition_variable cond{};
+};
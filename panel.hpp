@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+#include "hwif.hpp"
+#include "utils.hpp"
+#include "waveform.hpp"
+
+namespace panel {
+
+/**
+ * Waveshare 7.5" V2, 800x480 pixels driven by an UC8179 controller. Pixels are packed one bit per
+ * pixel, with the first pixel in the most significant bit
+ */
+struct Waveshare7in5V2 {
+    static constexpr std::string_view name = "Waveshare 7.5\" V2";
+
+    static constexpr uint32_t width = 800;
+    static constexpr uint32_t height = 480;
+    static constexpr uint32_t stride = utils::div_ceil<uint32_t>(width, 8);
+    static constexpr uint32_t image_size = height * stride;
+
+    /* Upper bounds for how long the display may signal busy */
+    static constexpr std::chrono::milliseconds power_on_timeout{2000};
+    static constexpr std::chrono::milliseconds refresh_timeout{30000};
+
+    /* Sent after reset to power on and configure the display */
+    static constexpr auto init = hwif::script(
+        hwif::step(hwif::Command::PowerSettings, 0x17, 0x17, 0x3f, 0x3f, 0x11),
+        hwif::step(hwif::Command::VCOMDCSetting, 0x24),
+        hwif::step(hwif::Command::BoosterSoftStart, 0x27, 0x27, 0x2f, 0x17),
+        hwif::step(hwif::Command::PLLControl, 0x06),
+        hwif::step_and_wait(hwif::Command::PowerOn),
+        hwif::step(hwif::Command::PanelSettings, 0x3f),
+        hwif::step(hwif::Command::ResolutionSetting, width >> 8, width & 0xff, height >> 8,
+                   height & 0xff),
+        hwif::step(hwif::Command::DualSPI, 0x00),
+        hwif::step(hwif::Command::VCOMDataIntervalSetting, 0x10, 0x00),
+        hwif::step(hwif::Command::TCONSetting, 0x22),
+        hwif::step(hwif::Command::GateSourceStartSetting, 0x00, 0x00, 0x00, 0x00));
+
+    /* Dual SPI setting enabling image data on two lines, the second being the MM pin */
+    static constexpr uint8_t dual_spi = 0x10;
+
+    /* Flags read with GetStatus */
+    static constexpr uint8_t status_idle = 0x01;
+    static constexpr uint8_t status_powered = 0x04;
+
+    /* Temperature, in degrees Celsius, reported where there is no panel to measure, as when
+     * emulated or on a dry run */
+    static constexpr int8_t room_temperature = 22;
+
+    /* Coldest temperature, in degrees Celsius, to use the fast waveform at. Colder panels respond
+     * too slowly for its short phases */
+    static constexpr int fast_min_temperature = 10;
+
+    /* Look up table sets */
+    static constexpr const waveform::Profile &full = waveform::full;
+    static constexpr const waveform::Profile &fast = waveform::fast;
+    static constexpr const waveform::Profile &gray = waveform::gray;
+};
+
+} // namespace panel
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <span>
+#include <string>
+
+#include "utils.hpp"
+
+namespace pbm {
+
+/**
+ * Write 1 bit image as binary PBM (P4). Pixels are packed most significant bit first, with
+ * `stride` bytes per row, where a set bit is black
+ */
+inline void write(const std::string &filename, uint32_t width, uint32_t height, uint32_t stride,
+                  std::span<const uint8_t> data) {
+    const uint32_t row_size = utils::div_ceil<uint32_t>(width, 8);
+    if (data.size() < static_cast<size_t>(height) * stride || stride < row_size) {
+        throw utils::runtime_error("Image of {} bytes too small for {}x{}", data.size(), width,
+                                   height);
+    }
+
+    std::ofstream out{filename, std::ios::binary};
+    out << "P4\n" << width << ' ' << height << '\n';
+    if (stride == row_size) {
+        out.write(reinterpret_cast<const char *>(data.data()), height * stride);
+    } else {
+        for (uint32_t row = 0; row < height; row++) {
+            out.write(reinterpret_cast<const char *>(data.data() + row * stride), row_size);
+        }
+    }
+    if (!out) {
+        throw utils::runtime_error("Unable to write image to {}", filename);
+    }
+}
+
+/**
+ * Write 8 bit image as binary PGM (P5), with one byte per pixel and `max` as the white level
+ */
+inline void write_gray(const std::string &filename, uint32_t width, uint32_t height, uint8_t max,
+                       std::span<const uint8_t> data) {
+    if (data.size() < static_cast<size_t>(width) * height) {
+        throw utils::runtime_error("Image of {} bytes too small for {}x{}", data.size(), width,
+                                   height);
+    }
+
+    std::ofstream out{filename, std::ios::binary};
+    out << "P5\n" << width << ' ' << height << '\n' << static_cast<uint32_t>(max) << '\n';
+    out.write(reinterpret_cast<const char *>(data.data()), width * height);
+    if (!out) {
+        throw utils::runtime_error("Unable to write image to {}", filename);
+    }
+}
+
+} // namespace pbm
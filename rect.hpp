@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fmt/ostream.h>
+#include <ostream>
+#include <vector>
+
+/**
+ * Axis aligned rectangle, in pixels. Right and bottom edges are exclusive
+ */
+struct Rect {
+    uint32_t x{};
+    uint32_t y{};
+    uint32_t width{};
+    uint32_t height{};
+
+    uint32_t right() const {
+        return x + width;
+    }
+
+    uint32_t bottom() const {
+        return y + height;
+    }
+
+    uint32_t area() const {
+        return width * height;
+    }
+
+    bool empty() const {
+        return width == 0 || height == 0;
+    }
+
+    bool operator==(const Rect &other) const = default;
+
+    /**
+     * Smallest rectangle covering both this and `other`
+     */
+    Rect united(const Rect &other) const {
+        const uint32_t left = std::min(x, other.x);
+        const uint32_t top = std::min(y, other.y);
+        return Rect{
+            .x = left,
+            .y = top,
+            .width = std::max(right(), other.right()) - left,
+            .height = std::max(bottom(), other.bottom()) - top,
+        };
+    }
+
+    /**
+     * Check if rectangles overlap, or are closer than `margin` pixels to each other
+     */
+    bool near(const Rect &other, uint32_t margin = 0) const {
+        return x <= other.right() + margin && other.x <= right() + margin &&
+               y <= other.bottom() + margin && other.y <= bottom() + margin;
+    }
+
+  private:
+    friend std::ostream &operator<<(std::ostream &ostream, const Rect &self) {
+        ostream << "[x=" << self.x << ", y=" << self.y << ", width=" << self.width
+                << ", height=" << self.height << "]";
+        return ostream;
+    }
+};
+template <> struct fmt::formatter<Rect> : ostream_formatter {};
+
+/**
+ * Merge rectangles that overlap, or are within `margin` pixels of each other. Merging is repeated
+ * until no rectangles are near each other, as a merged rectangle might grow into a third one
+ */
+inline std::vector<Rect> merge_rects(std::vector<Rect> rects, uint32_t margin = 0) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < rects.size(); i++) {
+            for (size_t j = i + 1; j < rects.size();) {
+                if (rects[i].near(rects[j], margin)) {
+                    rects[i] = rects[i].united(rects[j]);
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                } else {
+                    j++;
+                }
+            }
+        }
+    }
+    return rects;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "common.hpp"
+#include "hwif.hpp"
+#include "trace.hpp"
+
+namespace trace {
+
+/**
+ * Feed a recorded trace back through `hwif`. At original speed events are issued with the same
+ * spacing as when recorded, at max speed only the busy waits are kept, as the display needs them.
+ * Control and reset pin toggles are recreated by `hwif` itself
+ */
+template <typename Panel>
+void replay(const Options &options, hwif::Hwif<Panel> &hwif, const std::string &filename) {
+    using namespace std::chrono;
+
+    const Logger log = options.get_logger(Logger::Facility::Trace, true);
+    Reader reader{filename};
+
+    /* Commands are held back until it is known if data or a busy wait follows */
+    std::optional<uint8_t> pending{};
+    const auto flush = [&] {
+        if (pending) {
+            hwif.send(static_cast<hwif::Command>(*pending));
+            pending.reset();
+        }
+    };
+
+    size_t commands = 0;
+    size_t bytes = 0;
+    microseconds recorded{};
+    microseconds recorded_waits{};
+    const auto start = steady_clock::now();
+    while (std::optional<Event> event = reader.next()) {
+        recorded = event->time;
+        if (options.replay_speed == ReplaySpeed::Original) {
+            /* Busy waits are recorded when they end, replay them from where they started */
+            std::this_thread::sleep_until(start + event->time - event->waited);
+        }
+
+        switch (event->type) {
+            case Record::Command:
+                flush();
+                pending = event->command;
+                commands += 1;
+                break;
+
+            case Record::Data:
+                if (!pending) {
+                    throw std::runtime_error("Trace has data without a command");
+                }
+                hwif.send(static_cast<hwif::Command>(*pending), event->data);
+                pending.reset();
+                bytes += event->data.size();
+                break;
+
+            case Record::Pin:
+                if (event->pin == Pin::Reset && event->active) {
+                    flush();
+                    hwif.reset();
+                }
+                break;
+
+            case Record::Wait:
+                if (pending) {
+                    hwif.send_and_wait(static_cast<hwif::Command>(*pending), event->timeout);
+                    pending.reset();
+                } else {
+                    hwif.wait_for_idle(event->timeout);
+                }
+                recorded_waits += event->waited;
+                break;
+        }
+    }
+    flush();
+
+    const auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+    log("Replayed {} commands with {} bytes of data in {}, recorded in {} of which {} busy",
+        commands, bytes, elapsed, duration_cast<milliseconds>(recorded),
+        duration_cast<milliseconds>(recorded_waits));
+}
+
+} // namespace trace
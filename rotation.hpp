@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+#include "common.hpp"
+#include "framebuffer.hpp"
+#include "utils.hpp"
+
+namespace rotation {
+
+/**
+ * Whether `rotation` swaps width and height
+ */
+constexpr bool sideways(Rotation rotation) {
+    return rotation == Rotation::Clockwise || rotation == Rotation::CounterClockwise;
+}
+
+/**
+ * Transpose 8x8 bit matrix. Row 0 is held in the most significant byte, and column 0 in the most
+ * significant bit of each byte. Bits are swapped in 2x2, 4x4 and finally 8x8 blocks, handling all
+ * eight rows at once in a single 64 bit word
+ */
+constexpr uint64_t transpose(uint64_t x) {
+    x = (x & 0xAA55AA55AA55AA55) | ((x & 0x00AA00AA00AA00AA) << 7) |
+        ((x >> 7) & 0x00AA00AA00AA00AA);
+    x = (x & 0xCCCC3333CCCC3333) | ((x & 0x0000CCCC0000CCCC) << 14) |
+        ((x >> 14) & 0x0000CCCC0000CCCC);
+    x = (x & 0xF0F0F0F00F0F0F0F) | ((x & 0x00000000F0F0F0F0) << 28) |
+        ((x >> 28) & 0x00000000F0F0F0F0);
+    return x;
+}
+
+/**
+ * Turn 1 bit image, packed most significant bit first, a quarter. The image is handled as 8x8
+ * blocks, each gathered from eight rows into a word, transposed and scattered as eight rows of the
+ * result. Reversing the order rows are gathered in turns the block clockwise instead of counter
+ * clockwise
+ */
+inline void turn_bits(const Framebuffer &frame, Framebuffer &result, bool clockwise) {
+    for (uint32_t y = 0; y < frame.height; y += 8) {
+        for (uint32_t column = 0; column < frame.width / 8; column++) {
+            uint64_t block = 0;
+            for (uint32_t i = 0; i < 8; i++) {
+                const uint32_t row = clockwise ? y + 7 - i : y + i;
+                block = block << 8 | frame.row(row)[column];
+            }
+            block = transpose(block);
+
+            const uint32_t target_column = clockwise ? (frame.height - 8 - y) / 8 : y / 8;
+            for (uint32_t i = 0; i < 8; i++) {
+                const uint32_t x = column * 8 + i;
+                const uint32_t target_row = clockwise ? x : frame.width - 1 - x;
+                result.row(target_row)[target_column] = block >> (56 - 8 * i);
+            }
+        }
+    }
+}
+
+/**
+ * Turn 1 bit image half a turn, by reversing the order of rows, bytes and bits
+ */
+inline void flip_bits(const Framebuffer &frame, Framebuffer &result) {
+    for (uint32_t y = 0; y < frame.height; y++) {
+        const std::span<const uint8_t> line = frame.row(y);
+        const std::span<uint8_t> target = result.row(frame.height - 1 - y);
+        std::ranges::transform(line, target.rbegin(), utils::reverse_bits);
+    }
+}
+
+/**
+ * Turn 8 bit image, one pixel at a time
+ */
+inline void turn_bytes(const Framebuffer &frame, Framebuffer &result, Rotation rotation) {
+    for (uint32_t y = 0; y < frame.height; y++) {
+        const std::span<const uint8_t> line = frame.row(y);
+        for (uint32_t x = 0; x < frame.width; x++) {
+            switch (rotation) {
+                case Rotation::None:
+                    result.row(y)[x] = line[x];
+                    break;
+                case Rotation::Clockwise:
+                    result.row(x)[frame.height - 1 - y] = line[x];
+                    break;
+                case Rotation::UpsideDown:
+                    result.row(frame.height - 1 - y)[frame.width - 1 - x] = line[x];
+                    break;
+                case Rotation::CounterClockwise:
+                    result.row(frame.width - 1 - x)[y] = line[x];
+                    break;
+            }
+        }
+    }
+}
+
+/**
+ * Turn image by `rotation`. One bit images, packed most significant bit first, need both width and
+ * height to be multiples of eight. Eight bit images can have any size
+ */
+inline Framebuffer rotate(const Framebuffer &frame, Rotation rotation) {
+    const bool swap = sideways(rotation);
+    Framebuffer result{swap ? frame.height : frame.width, swap ? frame.width : frame.height,
+                       frame.bits};
+
+    if (frame.bits == 8) {
+        turn_bytes(frame, result, rotation);
+        return result;
+    }
+    if (frame.bits != 1 || frame.width % 8 != 0 || frame.height % 8 != 0) {
+        throw utils::runtime_error("Unable to rotate {}x{} image with {} bits per pixel",
+                                   frame.width, frame.height, frame.bits);
+    }
+
+    switch (rotation) {
+        case Rotation::None:
+            for (uint32_t y = 0; y < frame.height; y++) {
+                std::ranges::copy(frame.row(y), result.row(y).begin());
+            }
+            break;
+        case Rotation::Clockwise:
+            turn_bits(frame, result, true);
+            break;
+        case Rotation::UpsideDown:
+            flip_bits(frame, result);
+            break;
+        case Rotation::CounterClockwise:
+            turn_bits(frame, result, false);
+            break;
+    }
+    return result;
+}
+
+} // namespace rotation
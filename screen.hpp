@@ -9,30 +9,107 @@
 #include <fmt/ranges.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
 #include <iterator>
+#include <map>
 #include <ranges>
 #include <span>
+#include <string_view>
 
 #include "common.hpp"
+#include "font.hpp"
 #include "forecast.hpp"
+#include "framebuffer.hpp"
+#include "glyphs.hpp"
+#include "layout.hpp"
 #include "netatmo.hpp"
+#include "rect.hpp"
+#include "rotation.hpp"
 #include "utils.hpp"
 
-class Screen {
+/**
+ * Renders weather onto an image the size of `Panel`, or the size of it turned a quarter when the
+ * panel is mounted sideways
+ */
+template <typename Panel> class Screen {
     static constexpr Cairo::Format FORMAT = Cairo::Format::FORMAT_A1;
 
-    /* It's worth pointing out that using the A1 format then only alpha channel
-     * will be used to draw pixels. As alpha is additive there is no way to
-     * draw black on white, so just mentally invert the image */
-    Cairo::RefPtr<Cairo::ImageSurface> surface = Cairo::ImageSurface::create(FORMAT, WIDTH, HEIGHT);
-    Cairo::RefPtr<Cairo::Context> context = Cairo::Context::create(surface);
+    /* Grayscale is rendered with eight bits of alpha, which the display reduces to four levels */
+    static constexpr Cairo::Format FORMAT_GRAY = Cairo::Format::FORMAT_A8;
 
     const Options &options;
+    const Layout layout;
     const Logger log = options.get_logger(Logger::Facility::Screen);
 
     /* Filename to store image in */
     const std::optional<std::string> &filename;
 
+    /* It's worth pointing out that using the A1 format then only alpha channel
+     * will be used to draw pixels. As alpha is additive there is no way to
+     * draw black on white, so just mentally invert the image. The surface and
+     * context are kept between renders, and cleared in place */
+    const Cairo::RefPtr<Cairo::ImageSurface> surface =
+        Cairo::ImageSurface::create(options.grayscale ? FORMAT_GRAY : FORMAT, width(), height());
+    const Cairo::RefPtr<Cairo::Context> context = Cairo::Context::create(surface);
+
+    /* Font used for all text, selected into the context once. Cairo keeps fonts scaled to each
+     * size in caches of its own */
+    const Cairo::RefPtr<Cairo::FontFace> font_face = font::load(layout.font, log);
+
+    /* Glyphs of all text drawn */
+    static constexpr std::string_view characters =
+        " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+        "abcdefghijklmnopqrstuvwxyz{|}~åäöÅÄÖ°";
+
+    /* Glyphs rasterised for each font size, when rendering with one bit per pixel */
+    std::map<double, glyphs::Atlas> atlases{};
+    const glyphs::Atlas *atlas{};
+
+    /**
+     * Draw text that follows with font of `size`
+     */
+    void set_font_size(double size) {
+        context->set_font_size(size);
+
+        const auto found = atlases.find(size);
+        atlas = found != atlases.end() ? &found->second : nullptr;
+    }
+
+    /**
+     * Draw `text` starting at `x` on baseline `y`. Text is copied from the atlas of the current
+     * font when it has all glyphs and fits within `bounds`, and rasterised by Cairo otherwise
+     */
+    void show_text(double x, double y, std::string_view text) {
+        if (atlas) {
+            surface->flush();
+            const glyphs::Canvas canvas{
+                .data = std::span(surface->get_data(),
+                                  static_cast<size_t>(height()) * surface->get_stride()),
+                .stride = static_cast<uint32_t>(surface->get_stride()),
+                .bounds = bounds,
+            };
+            const bool drawn = atlas->draw(canvas, x, y, text);
+            surface->mark_dirty();
+            if (drawn) {
+                return;
+            }
+        }
+        context->move_to(x, y);
+        context->show_text(std::string{text});
+    }
+
+    /**
+     * Clear the whole surface, leaving nothing drawn
+     */
+    void clear() {
+        context->save();
+        context->set_operator(Cairo::OPERATOR_CLEAR);
+        context->paint();
+        context->restore();
+    }
+
     /**
      * Representation of range from low to high value.
      *
@@ -62,44 +139,187 @@ class Screen {
         }
     };
 
+    /* Text showing a measured value, or a fixed label */
+    enum class Field {
+        IndoorNow,
+        IndoorMin,
+        IndoorMax,
+        OutdoorNow,
+        OutdoorMin,
+        OutdoorMax,
+        Rain,
+        Label,
+    };
+
     /**
-     * Represent an area
+     * Text to draw at a resolved position
      */
-    class Area {
-        Range x;
-        Range y;
+    struct Text {
+        Field field;
+        double x;
+        double y;
+        double size;
+        std::string label{};
+    };
 
-      public:
-        Area(Range x, Range y) : x(x), y(y) {
-        }
+    /**
+     * Layout resolved for one placement of the forecast, so that rendering a frame only has to
+     * fill in values
+     */
+    struct Plan {
+        /* Widget boxes */
+        Rect indoor;
+        Rect rain;
+        Rect outdoor;
+        Rect graph;
+        Rect rows;
+
+        /* Measured values */
+        std::vector<Text> indoor_texts;
+        std::vector<Text> rain_texts;
+        std::vector<Text> outdoor_texts;
+
+        /* Position of each forecast sample, and where graph and its annotations go */
+        std::vector<double> columns;
+        double graph_right;
+        double graph_top;
+        double graph_bottom;
+        double annotation_x;
+
+        /* Baselines of rows below the graph, and their labels */
+        double hours_y;
+        double wind_y;
+        double gusts_y;
+        double rain_y;
+        std::vector<Text> row_labels;
+    };
 
-        double left() const {
-            return x.lo;
-        }
-        double right() const {
-            return x.hi;
+    /**
+     * Resolve layout for the forecast placed right of the measured values, or alone on screen
+     */
+    Plan compile(bool values) const {
+        const Layout &l = layout;
+        const double w = width();
+        const double h = height();
+        const auto align = [](double v) {
+            return utils::round_down(static_cast<uint32_t>(std::max(v, 0.0)), 8u);
+        };
+
+        Plan plan{};
+        const uint32_t forecast_left = align(values ? l.values_width : l.forecast_left);
+        const double graph_x = forecast_left + l.graph_indent;
+        plan.graph_right = w - l.forecast_right;
+        const double step = (plan.graph_right - graph_x) / (l.samples - 1);
+        if (step < 1) {
+            throw utils::runtime_error("No room for {} samples between x={} and x={} of graph",
+                                       l.samples, graph_x, plan.graph_right);
         }
-        double width() const {
-            return abs(x.hi - x.lo);
+        for (uint32_t i = 0; i < l.samples; i++) {
+            plan.columns.push_back(graph_x + i * step);
         }
+        plan.graph_top = l.graph_top;
+        plan.graph_bottom = h - 4 * l.row_height;
+        plan.annotation_x = forecast_left;
+
+        plan.rain_y = h - l.row_bottom;
+        plan.gusts_y = plan.rain_y - l.row_height;
+        plan.wind_y = plan.gusts_y - l.row_height;
+        plan.hours_y = plan.wind_y - l.row_height;
+        const double label_x = graph_x - l.row_label_indent;
+        plan.row_labels = {
+            {Field::Label, label_x, plan.wind_y, l.font_row_labels, l.wind_label},
+            {Field::Label, label_x, plan.gusts_y, l.font_row_labels, l.gusts_label},
+            {Field::Label, label_x, plan.rain_y, l.font_row_labels, l.rain_row_label},
+        };
 
-        double top() const {
-            return y.lo;
-        }
-        double bottom() const {
-            return y.hi;
+        const double above_large = l.font_large + l.spacing;
+        const double above_small = l.font_small + l.spacing;
+        const double below = l.font_small + l.spacing;
+        const double indoor_y = l.spacing + l.font_small + l.spacing + l.font_large;
+        const double outdoor_y = h - l.spacing - l.font_small - l.spacing;
+        const double rain_y = h / 2.0 + l.font_small / 2;
+        plan.indoor_texts = {
+            {Field::IndoorNow, l.indent_small, indoor_y, l.font_large},
+            {Field::IndoorMax, l.indent_large, indoor_y - above_large, l.font_small},
+            {Field::IndoorMin, l.indent_large, indoor_y + below, l.font_small},
+            {Field::Label, l.indent_small, indoor_y - above_large, l.font_tiny, l.indoor_label},
+        };
+        plan.outdoor_texts = {
+            {Field::OutdoorNow, l.indent_small, outdoor_y, l.font_large},
+            {Field::OutdoorMax, l.indent_large, outdoor_y - above_large, l.font_small},
+            {Field::OutdoorMin, l.indent_large, outdoor_y + below, l.font_small},
+            {Field::Label, l.indent_small, outdoor_y - above_large, l.font_tiny, l.outdoor_label},
+        };
+        plan.rain_texts = {
+            {Field::Rain, l.indent_small, rain_y, l.font_small},
+            {Field::Label, l.indent_small, rain_y - above_small, l.font_tiny, l.rain_label},
+        };
+
+        /* Measured values are left of the forecast, above its rows of wind and rain */
+        const uint32_t rows_left = align(label_x);
+        const uint32_t rows_top = align(plan.wind_y - l.font_rows);
+        const uint32_t rain_top = align(rain_y - above_small - l.font_tiny);
+        const uint32_t outdoor_top = align(outdoor_y - above_large - l.font_small);
+        if (forecast_left >= width() || rows_left >= width() || rows_top >= height() ||
+            rain_top >= outdoor_top || outdoor_top >= height()) {
+            throw utils::runtime_error("Layout does not fit on {}x{} screen", width(), height());
         }
-        double height() const {
-            return abs(y.hi - y.lo);
+        plan.indoor = {.x = 0, .y = 0, .width = forecast_left, .height = rain_top};
+        plan.rain = {
+            .x = 0, .y = rain_top, .width = forecast_left, .height = outdoor_top - rain_top};
+        plan.outdoor = {
+            .x = 0, .y = outdoor_top, .width = rows_left, .height = height() - outdoor_top};
+        plan.graph = {
+            .x = forecast_left, .y = 0, .width = width() - forecast_left, .height = rows_top};
+        plan.rows = {.x = rows_left,
+                     .y = rows_top,
+                     .width = width() - rows_left,
+                     .height = height() - rows_top};
+        return plan;
+    }
+
+    /**
+     * Draw texts of a plan, filling in measured values
+     */
+    void draw_texts(const std::vector<Text> &texts, const Weather::MeasuredData &mdp) {
+        for (const Text &text : texts) {
+            set_font_size(text.size);
+            switch (text.field) {
+                case Field::IndoorNow:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.indoor.now));
+                    break;
+                case Field::IndoorMin:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.indoor.min));
+                    break;
+                case Field::IndoorMax:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.indoor.max));
+                    break;
+                case Field::OutdoorNow:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.outdoor.now));
+                    break;
+                case Field::OutdoorMin:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.outdoor.min));
+                    break;
+                case Field::OutdoorMax:
+                    show_text(text.x, text.y, fmt::format("{}°", mdp.outdoor.max));
+                    break;
+                case Field::Rain:
+                    show_text(text.x, text.y,
+                              fmt::format("{:.1f} / {:.1f}", mdp.rain.last_1h, mdp.rain.last_24h));
+                    break;
+                case Field::Label:
+                    show_text(text.x, text.y, text.label);
+                    break;
+            }
         }
-    };
+    }
 
     /**
-     * Draw forecast on given area
+     * Draw forecasted temperatures as a graph, with the hour of each sample below
      */
-    void draw_forecast(const std::vector<Forecast::DataPoint> &dps, const Area &area) {
-        /* number of samples, limit to coming 12 h */
-        const size_t samples = std::min<size_t>(dps.size(), 12);
+    void draw_graph(const std::vector<Forecast::DataPoint> &dps, const Plan &plan) {
+        const std::vector<double> &columns = plan.columns;
+        const size_t samples = std::min(dps.size(), columns.size());
 
         /* Relavant temperature range */
         const auto &get_temp = [](const Forecast::DataPoint &dp) -> double {
@@ -108,15 +328,7 @@ class Screen {
         const auto temperatures = dps | std::views::take(samples) | std::views::transform(get_temp);
         const auto [minp, maxp] = std::ranges::minmax_element(temperatures);
         const Range temperature_range(*minp, *maxp);
-
-        /* Limit graph area */
-        const double graph_x_offset = area.left() + 50;
-        const double graph_width = area.width() - 50;
-        const double graph_y_offset = area.top() + 30;
-        const Range graph_y_range(area.bottom() - 30 - 30 - 30 - 30, graph_y_offset);
-
-        const double steps = samples - 1;
-        const double step_size = graph_width / steps;
+        const Range graph_y_range(plan.graph_bottom, plan.graph_top);
 
         /* Grading: there should never be more than 7-9 lines. If range is including, or
          * "close" to zero, there should be a zero line. (Close meaning wihin 1°C of zero)
@@ -155,9 +367,7 @@ class Screen {
         /* Conversion object that maps input temperature range, to screen pixels */
         const Conv conv{input_range, graph_y_range};
 
-        context->set_font_size(20.0);
-        context->select_font_face("cairo:sans-serif", Cairo::FONT_SLANT_NORMAL,
-                                  Cairo::FONT_WEIGHT_NORMAL);
+        set_font_size(layout.font_graph);
         /* Draw the levels, and annotate them */
         for (int l = input_range.lo; l <= input_range.hi; l += block_size) {
             if (l == 0) {
@@ -168,181 +378,255 @@ class Screen {
                 context->set_line_width(1);
                 context->set_dash(std::vector{1.0, 5.0}, 0.0);
             }
-            context->move_to(graph_x_offset, conv(l));
-            context->rel_line_to(graph_width, 0);
+            context->move_to(columns.front(), conv(l));
+            context->line_to(plan.graph_right, conv(l));
             context->stroke();
 
             /* Print temperature */
-            context->move_to(area.left(), conv(l) + 5);
-            context->show_text(fmt::format("{}°", l));
+            show_text(plan.annotation_x, conv(l) + layout.annotation_offset,
+                      fmt::format("{}°", l));
         }
 
         /* Draw timestamps below graph */
-        {
-            context->set_font_size(22.0);
-            double clock_x = graph_x_offset;
-            const auto get_time = [](const auto &dp) { return dp.time; };
-            const auto timestamps =
-                dps | std::views::take(samples - 1) | std::views::transform(get_time);
-            const double clock_y = area.bottom() - 10 - 30 - 30 - 30;
-            for (const auto &timestamp : timestamps) {
-                context->move_to(clock_x, clock_y);
-                context->show_text(fmt::format("{:%H}", timestamp));
-                clock_x += step_size;
-            }
+        set_font_size(layout.font_rows);
+        for (size_t i = 0; i + 1 < samples; i++) {
+            show_text(columns[i], plan.hours_y, fmt::format("{:%H}", dps[i].time));
         }
 
-        /* Show windspeed */
-        {
-            double x = graph_x_offset;
-            const auto get_windspeed = [](const auto &dp) { return dp.windspeed; };
-            const auto windspeeds =
-                dps | std::views::take(samples - 1) | std::views::transform(get_windspeed);
-            const double y = area.bottom() - 10 - 30 - 30;
-            for (const auto &windspeed : windspeeds) {
-                context->move_to(x, y);
-                context->show_text(fmt::format("{:.0f}", std::round(windspeed)));
-                x += step_size;
-            }
+        /* Draw temperature curve */
+        context->set_line_width(4.0);
+        context->unset_dash();
+        context->move_to(columns[0], conv(dps[0].temperature));
+        for (size_t i = 1; i < samples; i++) {
+            context->line_to(columns[i], conv(dps[i].temperature));
         }
+        context->stroke();
 
-        /* Show gusts */
-        {
-            double x = graph_x_offset;
-            const auto get_gust = [](const auto &dp) { return dp.gusts; };
-            const auto gusts =
-                dps | std::views::take(samples - 1) | std::views::transform(get_gust);
-            const double y = area.bottom() - 10 - 30;
-            for (const auto &gust : gusts) {
-                context->move_to(x, y);
-                context->show_text(fmt::format("{:.0f}", std::round(gust)));
-                x += step_size;
+        /* Shade area below temperature curve, when there are gray levels to do it with */
+        if (options.grayscale) {
+            context->move_to(columns[0], conv(input_range.lo));
+            for (size_t i = 0; i < samples; i++) {
+                context->line_to(columns[i], conv(dps[i].temperature));
             }
+            context->line_to(columns[samples - 1], conv(input_range.lo));
+            context->close_path();
+            context->set_source_rgba(0.0, 0.0, 0.0, 0.25);
+            context->fill();
+            context->set_source_rgba(0.0, 0.0, 0.0, 1.0);
         }
+    }
 
-        /* Show rain */
-        {
-            double x = graph_x_offset;
-            const auto get_rain = [](const auto &dp) { return dp.rain; };
-            const auto rains =
-                dps | std::views::take(samples - 1) | std::views::transform(get_rain);
-            const double y = area.bottom() - 10;
-            for (const auto &rain : rains) {
-                if (rain > 0) {
-                    context->move_to(x, y);
-                    context->show_text(fmt::format("{:.1f}", rain));
-                }
-                x += step_size;
+    /**
+     * Draw forecasted wind, gusts and rain as rows of numbers below the graph
+     */
+    void draw_rows(const std::vector<Forecast::DataPoint> &dps, const Plan &plan) {
+        const size_t samples = std::min(dps.size(), plan.columns.size());
+
+        set_font_size(layout.font_rows);
+        for (size_t i = 0; i + 1 < samples; i++) {
+            const double x = plan.columns[i];
+            show_text(x, plan.wind_y, fmt::format("{:.0f}", std::round(dps[i].windspeed)));
+            show_text(x, plan.gusts_y, fmt::format("{:.0f}", std::round(dps[i].gusts)));
+            if (dps[i].rain > 0) {
+                show_text(x, plan.rain_y, fmt::format("{:.1f}", dps[i].rain));
             }
         }
 
-        {
-            context->set_font_size(14.0);
-            const double x = graph_x_offset + 5;
-            double y = area.bottom() - 10 - 3 * 30;
-            context->move_to(x - 80.0, y += 30);
-            context->show_text("Vind, m/s");
-            context->move_to(x - 80.0, y += 30);
-            context->show_text("Byar, m/s");
-            context->move_to(x - 80.0, y += 30);
-            context->show_text("Regn, mm");
+        for (const Text &label : plan.row_labels) {
+            set_font_size(label.size);
+            show_text(label.x, label.y, label.label);
         }
+    }
 
-        /* Draw temperature curve */
-        context->set_line_width(4.0);
-        context->unset_dash();
-        double graph_x = graph_x_offset;
-        context->move_to(graph_x, conv(dps[0].temperature));
-        for (const auto temperature : temperatures | std::views::drop(1)) {
-            context->line_to(graph_x += step_size, conv(temperature));
+    /**
+     * Part of the screen drawn on its own, from the values in `inputs`. It is only redrawn when
+     * its inputs change, and never draws outside of its box
+     */
+    struct Widget {
+        std::string_view name;
+        Rect box;
+        std::vector<double> inputs;
+        std::function<void()> draw;
+    };
+
+    /**
+     * Split screen into widgets, as placed by `plan`
+     */
+    std::vector<Widget> widgets(const Plan &plan,
+                                const std::optional<std::vector<Forecast::DataPoint>> &dps,
+                                const std::optional<Weather::MeasuredData> &mdp) {
+        std::vector<Widget> result{};
+        if (mdp) {
+            result.push_back(Widget{
+                .name = "indoor",
+                .box = plan.indoor,
+                .inputs = {mdp->indoor.now, mdp->indoor.min, mdp->indoor.max},
+                .draw = [this, &plan, &mdp] { draw_texts(plan.indoor_texts, *mdp); },
+            });
+            result.push_back(Widget{
+                .name = "rain",
+                .box = plan.rain,
+                .inputs = {mdp->rain.last_1h, mdp->rain.last_24h},
+                .draw = [this, &plan, &mdp] { draw_texts(plan.rain_texts, *mdp); },
+            });
+            result.push_back(Widget{
+                .name = "outdoor",
+                .box = plan.outdoor,
+                .inputs = {mdp->outdoor.now, mdp->outdoor.min, mdp->outdoor.max},
+                .draw = [this, &plan, &mdp] { draw_texts(plan.outdoor_texts, *mdp); },
+            });
         }
-        context->stroke();
+
+        Widget graph{
+            .name = "forecast",
+            .box = plan.graph,
+            .inputs = {},
+            .draw =
+                [this, &plan, &dps] {
+                    if (dps) {
+                        draw_graph(*dps, plan);
+                    }
+                },
+        };
+        Widget rows{
+            .name = "wind",
+            .box = plan.rows,
+            .inputs = {},
+            .draw =
+                [this, &plan, &dps] {
+                    if (dps) {
+                        draw_rows(*dps, plan);
+                    }
+                },
+        };
+        if (dps) {
+            for (const Forecast::DataPoint &dp : *dps | std::views::take(plan.columns.size())) {
+                graph.inputs.insert(graph.inputs.end(),
+                                    {dp.temperature, static_cast<double>(dp.time.tm_hour)});
+                rows.inputs.insert(rows.inputs.end(), {dp.windspeed, dp.gusts, dp.rain});
+            }
+        }
+        result.push_back(std::move(graph));
+        result.push_back(std::move(rows));
+        return result;
     }
 
     /**
-     * Draw current measured values
+     * Clear box of `widget`, and draw it within its box
      */
-    void draw_values(const Weather::MeasuredData &mdp) {
-        const double font_large = 56.0;
-        const double font_small = 32.0;
-        const double font_tiny = 14.0;
-        const double spacing = 5.0;
-        const double indent_small = 10.0;
-        const double indent_large = 40.0;
-        const double indoor_y = spacing + font_small + spacing + font_large;
-        const double outdoor_y = HEIGHT - spacing - font_small - spacing;
-        const double rain_y = HEIGHT / 2.0 + font_small / 2;
-        const double above_large = font_large + spacing;
-        const double above_small = font_small + spacing;
-        const double below = font_small + spacing;
-
-        /* Set up font */
-        context->set_font_size(font_large);
-        context->select_font_face("cairo:sans-serif", Cairo::FONT_SLANT_NORMAL,
-                                  Cairo::FONT_WEIGHT_NORMAL);
-
-        /* Draw current temperatures */
-        context->move_to(indent_small, outdoor_y);
-        context->show_text(fmt::format("{}°", mdp.outdoor.now));
-
-        context->move_to(indent_small, indoor_y);
-        context->show_text(fmt::format("{}°", mdp.indoor.now));
-
-        context->set_font_size(font_small);
-        context->move_to(indent_small, rain_y);
-        context->show_text(fmt::format("{:.1f} / {:.1f}", mdp.rain.last_1h, mdp.rain.last_24h));
-
-        /* Draw min/max as smaller text next to current values */
-        context->move_to(indent_large, indoor_y - above_large);
-        context->show_text(fmt::format("{}°", mdp.indoor.max));
-        context->move_to(indent_large, indoor_y + below);
-        context->show_text(fmt::format("{}°", mdp.indoor.min));
-
-        context->move_to(indent_large, outdoor_y - above_large);
-        context->show_text(fmt::format("{}°", mdp.outdoor.max));
-        context->move_to(indent_large, outdoor_y + below);
-        context->show_text(fmt::format("{}°", mdp.outdoor.min));
-
-        /* Annotation */
-        context->set_font_size(font_tiny);
-        context->move_to(indent_small, indoor_y - above_large);
-        context->show_text("Inne");
-        context->move_to(indent_small, outdoor_y - above_large);
-        context->show_text("Ute");
-        context->move_to(indent_small, rain_y - above_small);
-        context->show_text("Regn (mm), 1h/24h");
+    void draw_widget(const Widget &widget) {
+        const Rect &box = widget.box;
+        context->save();
+        context->rectangle(box.x, box.y, box.width, box.height);
+        context->clip();
+        context->save();
+        context->set_operator(Cairo::OPERATOR_CLEAR);
+        context->paint();
+        context->restore();
+
+        bounds = box;
+        widget.draw();
+        bounds = whole();
+        context->restore();
+    }
+
+    Rect whole() const {
+        return Rect{.x = 0, .y = 0, .width = width(), .height = height()};
     }
 
     uint32_t render_number = 0;
 
+    /* Where text may be drawn, which is the box of the widget being drawn */
+    Rect bounds = whole();
+
+    /* Layout resolved without and with measured values on screen */
+    const std::array<Plan, 2> plans{compile(false), compile(true)};
+
+    /* Position of forecast, and inputs of each widget, as last drawn */
+    std::optional<uint32_t> drawn_layout{};
+    std::map<std::string_view, std::vector<double>> drawn_inputs{};
+
+    /* Size of rendering, before it is turned to fit the panel */
+    uint32_t width() const {
+        return rotation::sideways(options.rotation) ? Panel::height : Panel::width;
+    }
+
+    uint32_t height() const {
+        return rotation::sideways(options.rotation) ? Panel::width : Panel::height;
+    }
+
   public:
-    Screen(const Options &options) : options(options), filename(options.render_store) {
+    Screen(const Options &options, const Layout &layout)
+        : options(options), layout(layout), filename(options.render_store) {
         context->set_source_rgba(0.0, 0.0, 0.0, 1.0);
+        context->set_font_face(font_face);
+
+        /* Gray text is anti-aliased, which the one bit glyphs can't show */
+        if (not options.grayscale) {
+            for (double size : {layout.font_large, layout.font_small, layout.font_tiny,
+                                layout.font_graph, layout.font_rows, layout.font_row_labels}) {
+                set_font_size(size);
+                atlases.try_emplace(size, context->get_scaled_font(), characters);
+            }
+            log("Rasterised glyphs for {} font sizes", atlases.size());
+        }
     }
 
     /**
-     * Draw forecast and measured values on screen
+     * Draw forecast and measured values on screen. Only widgets drawn from values that changed
+     * are redrawn, and the regions they cover are returned. Nothing is returned if nothing changed
+     *
+     * Regions are in coordinates of the rendering, before it is turned to how the panel is
+     * mounted, and are only meant to tell whether there is anything new to show. Display finds
+     * what to refresh by comparing against the frame last shown, which may be older than the
+     * previous render, as frames can be replaced before being drawn or fail to draw
      */
-    void draw(const std::optional<std::vector<Forecast::DataPoint>> &dps,
-              const std::optional<Weather::MeasuredData> &mdp) {
-        log("Drawing data points to screen");
-        surface = Cairo::ImageSurface::create(FORMAT, WIDTH, HEIGHT);
-        context = Cairo::Context::create(surface);
+    std::vector<Rect> draw(const std::optional<std::vector<Forecast::DataPoint>> &dps,
+                           const std::optional<Weather::MeasuredData> &mdp) {
+        using namespace std::chrono;
 
-        if (mdp) {
-            draw_values(*mdp);
+        log("Drawing data points to screen");
+        const auto start = steady_clock::now();
+
+        /* Widgets move when measured values come or go, so everything is drawn anew */
+        std::vector<Rect> changed{};
+        uint32_t redrawn = 0;
+        const uint32_t placement = mdp ? 1 : 0;
+        if (drawn_layout != placement) {
+            clear();
+            drawn_inputs.clear();
+            drawn_layout = placement;
+            changed.push_back(whole());
         }
-        if (dps) {
-            draw_forecast(*dps, Area(Range(mdp ? 192 : 40, WIDTH - 10), Range(0, HEIGHT)));
+        for (const Widget &widget : widgets(plans[placement], dps, mdp)) {
+            auto [drawn, inserted] = drawn_inputs.try_emplace(widget.name, widget.inputs);
+            if (!inserted && drawn->second == widget.inputs) {
+                continue;
+            }
+            drawn->second = widget.inputs;
+            draw_widget(widget);
+            changed.push_back(widget.box);
+            redrawn += 1;
         }
+        surface->flush();
+        log("Rendered {} widgets in {}", redrawn,
+            duration_cast<microseconds>(steady_clock::now() - start));
 
-        if (filename) {
+        if (filename && !changed.empty()) {
             surface->write_to_png(fmt::format("{}-{}.png", *filename, render_number));
             render_number += 1;
         }
+        return merge_rects(std::move(changed));
     }
 
-    std::span<uint8_t, IMG_SIZE> get_ptr() {
-        return std::span<uint8_t, IMG_SIZE>{surface->get_data(), IMG_SIZE};
+    /**
+     * Get copy of rendering, with one bit per pixel, or one byte per pixel when in grayscale. Rows
+     * keep the padding Cairo gives them
+     */
+    Framebuffer get_framebuffer() {
+        const uint32_t stride = surface->get_stride();
+        const std::span<const uint8_t> data{surface->get_data(),
+                                            static_cast<size_t>(height()) * stride};
+        return Framebuffer{width(), height(), options.grayscale ? 8u : 1u, stride, data};
     }
 };
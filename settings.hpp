@@ -1,10 +1,13 @@
 #pragma once
 
 #include <fmt/core.h>
+#include <limits>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "common.hpp"
+#include "layout.hpp"
 
 extern "C" {
 #include <lauxlib.h>
@@ -40,6 +43,65 @@ struct Settings : public Options {
         } catch (const std::runtime_error &err) {
             fmt::print("No (valid) position provided, will use netatmo position\n");
         }
+
+        if (file.has_global("layout")) {
+            layout = read_layout(file.get_table("layout"), layout);
+        }
+
+        /* Panels are listed like `panels = {{spi = "/dev/spidev0.1", busy = 13, rotate = 90}}`,
+         * where fields left out are as given on the command line, or as wired on the HAT. A
+         * panel may have a `layout` table of its own, with fields left out as in the global one */
+        if (not file.has_global("panels")) {
+            panels.push_back({.wiring = wiring, .rotation = rotation, .layout = layout});
+            return;
+        }
+        LuaTable panels_table = file.get_table("panels");
+        for (lua_Integer i = 1; i <= panels_table.length(); i++) {
+            LuaTable panel_table = panels_table.get_table_index(i);
+            PanelSettings panel{.wiring = wiring, .rotation = rotation, .layout = layout};
+            if (std::optional<std::string> device = panel_table.get_optional_string_field("spi")) {
+                panel.wiring.spi_device = *device;
+            }
+            for (auto [name, pin] : {
+                     std::pair{"reset", &panel.wiring.reset_pin},
+                     std::pair{"control", &panel.wiring.control_pin},
+                     std::pair{"busy", &panel.wiring.busy_pin},
+                 }) {
+                if (std::optional<lua_Integer> value =
+                        panel_table.get_optional_integer_field(name)) {
+                    *pin = *value;
+                }
+            }
+            if (std::optional<lua_Integer> degrees =
+                    panel_table.get_optional_integer_field("rotate")) {
+                panel.rotation = to_rotation(*degrees);
+            }
+            if (panel_table.has_field("layout")) {
+                panel.layout = read_layout(panel_table.get_table_field("layout"), layout);
+            }
+            panels.push_back(panel);
+        }
+        if (panels.empty()) {
+            throw utils::runtime_error("Expected at least one panel in panels");
+        }
+    }
+
+    /**
+     * Options for the panel at `index`. When there are several panels, files written for each are
+     * told apart by the index of the panel
+     */
+    Options panel_options(size_t index) const {
+        Options options{*this};
+        options.wiring = panels[index].wiring;
+        options.rotation = panels[index].rotation;
+        if (panels.size() > 1) {
+            for (std::optional<std::string> *file : {&options.render_store, &options.trace_store}) {
+                if (*file) {
+                    **file = fmt::format("{}-{}", **file, index);
+                }
+            }
+        }
+        return options;
     }
 
     struct Netatmo {
@@ -64,7 +126,34 @@ struct Settings : public Options {
 
     std::optional<Position> position{};
 
+    /* Where things are drawn, as given by the optional `layout` table, unless a panel has a
+     * layout of its own */
+    Layout layout{};
+
+    /* How each panel is wired and mounted, and what is drawn where on it. Each panel is driven
+     * from a thread of its own */
+    struct PanelSettings {
+        Wiring wiring;
+        Rotation rotation;
+        Layout layout;
+    };
+    std::vector<PanelSettings> panels{};
+
   private:
+    static Rotation to_rotation(lua_Integer degrees) {
+        switch (degrees) {
+            case 0:
+                return Rotation::None;
+            case 90:
+                return Rotation::Clockwise;
+            case 180:
+                return Rotation::UpsideDown;
+            case 270:
+                return Rotation::CounterClockwise;
+        }
+        throw utils::runtime_error("Unable to rotate panel by {} degrees", degrees);
+    }
+
     /* TODO: Generalize this approach not always look at top of stack, instead keep track of height
      * of stack, and the position of self. */
     /* Helper object for automatic stack popping */
@@ -105,8 +194,131 @@ struct Settings : public Options {
             }
             return LuaTable{L};
         }
+
+        LuaTable get_table_index(lua_Integer index) {
+            int status = lua_geti(L, -1, index);
+            if (status != LUA_TTABLE) {
+                throw utils::runtime_error("Expected entry {} to be a table, but it's not", index);
+            }
+            return LuaTable{L};
+        }
+
+        std::optional<std::string> get_optional_string_field(const char *name) const {
+            LuaObj field{L};
+            int status = lua_getfield(L, -1, name);
+            if (status == LUA_TNIL) {
+                return std::nullopt;
+            } else if (status != LUA_TSTRING) {
+                throw utils::runtime_error("Expected field {} to be a string, but it's not", name);
+            }
+            return lua_tostring(L, -1);
+        }
+
+        std::optional<lua_Integer> get_optional_integer_field(const char *name) const {
+            LuaObj field{L};
+            int status = lua_getfield(L, -1, name);
+            if (status == LUA_TNIL) {
+                return std::nullopt;
+            } else if (not lua_isinteger(L, -1)) {
+                throw utils::runtime_error("Expected field {} to be an integer, but it's not",
+                                           name);
+            }
+            return lua_tointeger(L, -1);
+        }
+
+        std::optional<lua_Number> get_optional_number_field(const char *name) const {
+            LuaObj field{L};
+            int status = lua_getfield(L, -1, name);
+            if (status == LUA_TNIL) {
+                return std::nullopt;
+            } else if (status != LUA_TNUMBER) {
+                throw utils::runtime_error("Expected field {} to be a number, but it's not", name);
+            }
+            return lua_tonumber(L, -1);
+        }
+
+        bool has_field(const char *name) const {
+            LuaObj field{L};
+            return lua_getfield(L, -1, name) != LUA_TNIL;
+        }
+
+        lua_Integer length() const {
+            return luaL_len(L, -1);
+        }
     };
 
+    /**
+     * Layout given by `table`, with fields left out as in `defaults`
+     */
+    static Layout read_layout(const LuaTable &table, const Layout &defaults) {
+        Layout result{defaults};
+        for (auto [name, value] : {
+                 std::pair{"values_width", &result.values_width},
+                 std::pair{"font_large", &result.font_large},
+                 std::pair{"font_small", &result.font_small},
+                 std::pair{"font_tiny", &result.font_tiny},
+                 std::pair{"spacing", &result.spacing},
+                 std::pair{"indent_small", &result.indent_small},
+                 std::pair{"indent_large", &result.indent_large},
+                 std::pair{"forecast_left", &result.forecast_left},
+                 std::pair{"forecast_right", &result.forecast_right},
+                 std::pair{"graph_indent", &result.graph_indent},
+                 std::pair{"graph_top", &result.graph_top},
+                 std::pair{"annotation_offset", &result.annotation_offset},
+                 std::pair{"row_height", &result.row_height},
+                 std::pair{"row_bottom", &result.row_bottom},
+                 std::pair{"row_label_indent", &result.row_label_indent},
+                 std::pair{"font_graph", &result.font_graph},
+                 std::pair{"font_rows", &result.font_rows},
+                 std::pair{"font_row_labels", &result.font_row_labels},
+             }) {
+            if (std::optional<lua_Number> number = table.get_optional_number_field(name)) {
+                if (*number < 0) {
+                    throw utils::runtime_error(
+                        "Expected layout field {} not to be negative, got {}", name, *number);
+                }
+                *value = *number;
+            }
+        }
+        for (auto [name, value] : {
+                 std::pair{"font_large", result.font_large},
+                 std::pair{"font_small", result.font_small},
+                 std::pair{"font_tiny", result.font_tiny},
+                 std::pair{"font_graph", result.font_graph},
+                 std::pair{"font_rows", result.font_rows},
+                 std::pair{"font_row_labels", result.font_row_labels},
+                 std::pair{"row_height", result.row_height},
+             }) {
+            if (value <= 0) {
+                throw utils::runtime_error("Expected layout field {} to be positive, got {}", name,
+                                           value);
+            }
+        }
+        for (auto [name, label] : {
+                 std::pair{"indoor_label", &result.indoor_label},
+                 std::pair{"outdoor_label", &result.outdoor_label},
+                 std::pair{"rain_label", &result.rain_label},
+                 std::pair{"wind_label", &result.wind_label},
+                 std::pair{"gusts_label", &result.gusts_label},
+                 std::pair{"rain_row_label", &result.rain_row_label},
+             }) {
+            if (std::optional<std::string> text = table.get_optional_string_field(name)) {
+                *label = *text;
+            }
+        }
+        if (std::optional<std::string> font = table.get_optional_string_field("font")) {
+            result.font = *font;
+        }
+        if (std::optional<lua_Integer> samples = table.get_optional_integer_field("samples")) {
+            if (*samples < 2 || *samples > std::numeric_limits<uint32_t>::max()) {
+                throw utils::runtime_error("Expected between 2 and {} samples, got {}",
+                                           std::numeric_limits<uint32_t>::max(), *samples);
+            }
+            result.samples = *samples;
+        }
+        return result;
+    }
+
     struct LuaFile {
         lua_State *L = luaL_newstate();
 
@@ -124,6 +336,11 @@ struct Settings : public Options {
             lua_close(L);
         }
 
+        bool has_global(const char *name) {
+            LuaObj global{L};
+            return lua_getglobal(L, name) != LUA_TNIL;
+        }
+
         LuaTable get_table(const char *table) {
             int status = lua_getglobal(L, table);
             if (status != LUA_TTABLE) {
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace stats {
+
+/**
+ * Latency histogram with power of two buckets, bucket n holds samples below 2^n microseconds
+ */
+struct Histogram {
+    void add(std::chrono::microseconds sample) {
+        const auto us = static_cast<uint64_t>(std::max<int64_t>(sample.count(), 0));
+        counts[std::min<size_t>(std::bit_width(us), counts.size() - 1)] += 1;
+        samples += 1;
+    }
+
+    /**
+     * Upper bound of the bucket holding the given fraction of samples
+     */
+    std::chrono::microseconds percentile(double fraction) const {
+        const auto wanted = static_cast<uint64_t>(fraction * static_cast<double>(samples));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < counts.size(); bucket++) {
+            seen += counts[bucket];
+            if (seen > wanted || seen == samples) {
+                return std::chrono::microseconds(uint64_t{1} << bucket);
+            }
+        }
+        return {};
+    }
+
+    std::array<uint64_t, 40> counts{};
+    uint64_t samples{};
+};
+
+/**
+ * What has been spent on a command, or on a phase of drawing
+ */
+struct Counter {
+    uint64_t calls{};
+    uint64_t bytes{};
+    uint64_t syscalls{};
+    uint64_t waits{};
+    std::chrono::microseconds spi{};
+    std::chrono::microseconds busy{};
+    Histogram latency{};
+    Histogram busy_latency{};
+
+    /**
+     * Add the totals of `other`, leaving histograms as is
+     */
+    void add_totals(const Counter &other) {
+        bytes += other.bytes;
+        syscalls += other.syscalls;
+        waits += other.waits;
+        spi += other.spi;
+        busy += other.busy;
+    }
+
+    Counter totals_since(const Counter &before) const {
+        return Counter{
+            .bytes = bytes - before.bytes,
+            .syscalls = syscalls - before.syscalls,
+            .waits = waits - before.waits,
+            .spi = spi - before.spi,
+            .busy = busy - before.busy,
+        };
+    }
+};
+
+/**
+ * Counters keyed by command byte, and by phase name
+ */
+struct Set {
+    std::map<uint8_t, Counter> commands{};
+    std::map<std::string, Counter, std::less<>> phases{};
+    Counter total{};
+};
+
+/**
+ * Collects counters for one display. Counters are updated by the thread driving the display, and
+ * can be read from any thread
+ */
+struct Registry {
+    /**
+     * Account for a command sent over SPI
+     */
+    void command(uint8_t cmd, uint64_t bytes, uint64_t syscalls, std::chrono::microseconds spi) {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (Set *set : {&lifetime, &recent}) {
+            Counter &counter = set->commands[cmd];
+            counter.calls += 1;
+            counter.bytes += bytes;
+            counter.syscalls += syscalls;
+            counter.spi += spi;
+            counter.latency.add(spi);
+            set->total.calls += 1;
+            set->total.bytes += bytes;
+            set->total.syscalls += syscalls;
+            set->total.spi += spi;
+        }
+    }
+
+    /**
+     * Account for time spent waiting on busy, after `cmd` was sent
+     */
+    void wait(uint8_t cmd, std::chrono::microseconds busy) {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (Set *set : {&lifetime, &recent}) {
+            Counter &counter = set->commands[cmd];
+            counter.waits += 1;
+            counter.busy += busy;
+            counter.busy_latency.add(busy);
+            set->total.waits += 1;
+            set->total.busy += busy;
+        }
+    }
+
+    /**
+     * Account for a phase, with what was spent on commands while in it
+     */
+    void phase(std::string_view name, const Counter &spent, std::chrono::microseconds elapsed) {
+        std::lock_guard<std::mutex> lock{mutex};
+        for (Set *set : {&lifetime, &recent}) {
+            auto found = set->phases.find(name);
+            if (found == set->phases.end()) {
+                found = set->phases.emplace(name, Counter{}).first;
+            }
+            found->second.calls += 1;
+            found->second.add_totals(spent);
+            found->second.latency.add(elapsed);
+        }
+    }
+
+    Counter total() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return lifetime.total;
+    }
+
+    Set all() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return lifetime;
+    }
+
+    /**
+     * Counters since last call
+     */
+    Set take_recent() {
+        std::lock_guard<std::mutex> lock{mutex};
+        return std::exchange(recent, Set{});
+    }
+
+  private:
+    mutable std::mutex mutex{};
+    Set lifetime{};
+    Set recent{};
+};
+
+/**
+ * Accounts for a phase when leaving scope, including the commands sent while in it. Phases can be
+ * nested, the outer phase then includes the inner
+ */
+struct Scope {
+    Scope(Registry &registry, std::string_view name)
+        : registry{registry}, name{name}, before{registry.total()} {
+    }
+
+    ~Scope() {
+        using namespace std::chrono;
+        const auto elapsed = duration_cast<microseconds>(steady_clock::now() - start);
+        registry.phase(name, registry.total().totals_since(before), elapsed);
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Registry &registry;
+    std::string_view name;
+    Counter before;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+/**
+ * Format a counter on one line. Latency percentiles are bucket upper bounds
+ */
+inline std::string format(const Counter &counter) {
+    using namespace std::chrono;
+    std::string line = fmt::format("{} calls, {} bytes, {} syscalls, spi {}, busy {} in {} waits",
+                                   counter.calls, counter.bytes, counter.syscalls,
+                                   duration_cast<milliseconds>(counter.spi),
+                                   duration_cast<milliseconds>(counter.busy), counter.waits);
+    if (counter.latency.samples) {
+        line += fmt::format(", latency p50 < {} p99 < {}", counter.latency.percentile(0.5),
+                            counter.latency.percentile(0.99));
+    }
+    if (counter.busy_latency.samples) {
+        line += fmt::format(", busy p50 < {} p99 < {}", counter.busy_latency.percentile(0.5),
+                            counter.busy_latency.percentile(0.99));
+    }
+    return line;
+}
+
+/**
+ * Format all counters in a set, one line each
+ */
+inline std::vector<std::string> format(const Set &set) {
+    std::vector<std::string> lines{};
+    lines.push_back(fmt::format("total: {}", format(set.total)));
+    for (const auto &[name, counter] : set.phases) {
+        lines.push_back(fmt::format("phase {}: {}", name, format(counter)));
+    }
+    for (const auto &[cmd, counter] : set.commands) {
+        lines.push_back(fmt::format("command {:#04x}: {}", cmd, format(counter)));
+    }
+    return lines;
+}
+
+/**
+ * Runs `dump` each time the process receives `signal`. The signal needs to be blocked in all
+ * threads, which is done by `block` before any thread is started
+ */
+struct SignalDumper {
+    SignalDumper(int signal, std::function<void()> dump)
+        : signal{signal}, dump{std::move(dump)}, thread{&SignalDumper::run, this} {
+    }
+
+    ~SignalDumper() {
+        stopping = true;
+        pthread_kill(thread.native_handle(), signal);
+        thread.join();
+    }
+
+    static void block(int signal) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, signal);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    }
+
+  private:
+    void run() {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, signal);
+        int received = 0;
+        while (sigwait(&set, &received) == 0 && !stopping) {
+            dump();
+        }
+    }
+
+    int signal;
+    std::function<void()> dump;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+};
+
+} // namespace stats
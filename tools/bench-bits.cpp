@@ -0,0 +1,92 @@
+/**
+ * Microbenchmark of the bit order conversion done by Display::render, comparing the mask-and-shift
+ * steps of utils::reverse_bits against a 256 entry look up table. Build and run on the target with
+ * `make bench`
+ */
+#include <fmt/chrono.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <string_view>
+
+#include "../framebuffer.hpp"
+#include "../utils.hpp"
+
+namespace {
+
+/* Geometry of panel::Waveshare7in5V2, without pulling in the hardware interface */
+constexpr uint32_t width = 800;
+constexpr uint32_t height = 480;
+
+/* Bit reversed bytes, indexed by the byte to reverse */
+constexpr std::array<uint8_t, 256> reversed_bits = [] {
+    std::array<uint8_t, 256> table{};
+    for (size_t i = 0; i < table.size(); i++) {
+        table[i] = utils::reverse_bits(static_cast<uint8_t>(i));
+    }
+    return table;
+}();
+
+/* Frames converted per variant, after as many warm up frames */
+constexpr uint32_t rounds = 2000;
+
+/**
+ * Convert `frame` into `packed` row by row, as Display::render does, with `reverse` per byte
+ */
+template <typename F> void convert(const Framebuffer &frame, Framebuffer &packed, F reverse) {
+    for (uint32_t row = 0; row < frame.height; row++) {
+        std::ranges::transform(frame.row(row), packed.row(row).begin(), reverse);
+    }
+}
+
+/**
+ * Time `rounds` conversions of `frame`, printing time per frame. Returns checksum of the result,
+ * which keeps the conversions from being optimised away
+ */
+template <typename F>
+uint64_t measure(std::string_view name, const Framebuffer &frame, F reverse) {
+    using namespace std::chrono;
+    Framebuffer packed{frame.width, frame.height};
+    for (uint32_t i = 0; i < rounds; i++) {
+        convert(frame, packed, reverse);
+    }
+
+    const auto start = steady_clock::now();
+    for (uint32_t i = 0; i < rounds; i++) {
+        convert(frame, packed, reverse);
+        asm volatile("" : : "r"(packed.bytes().data()) : "memory");
+    }
+    const auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start);
+    fmt::print("{:>8}: {:>8.1f} us per frame\n", name, elapsed.count() / 1000.0 / rounds);
+
+    uint64_t sum = 0;
+    for (uint8_t byte : packed.bytes()) {
+        sum = sum * 31 + byte;
+    }
+    return sum;
+}
+
+} // namespace
+
+int main() {
+    /* Cairo pads A1 rows to whole 32 bit words */
+    const uint32_t stride = utils::round_up<uint32_t>(utils::div_ceil<uint32_t>(width, 8), 4);
+    std::vector<uint8_t> pixels(static_cast<size_t>(height) * stride);
+    std::mt19937 random{1};
+    std::ranges::generate(pixels, [&] { return static_cast<uint8_t>(random()); });
+    const Framebuffer frame{width, height, 1, stride, pixels};
+
+    const uint64_t shifted = measure("shifts", frame, utils::reverse_bits);
+    const uint64_t looked_up =
+        measure("table", frame, [](uint8_t byte) { return reversed_bits[byte]; });
+
+    if (shifted != looked_up) {
+        fmt::print("Results differ\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils.hpp"
+
+namespace trace {
+
+/*
+ * A trace starts with `magic`, followed by records. Each record starts with a type byte, and the
+ * number of microseconds since the previous record. Numbers are stored as LEB128 varints
+ *
+ *   Command: command byte
+ *   Data:    length, followed by bytes
+ *   Pin:     pin number shifted one step left, with level as lowest bit
+ *   Wait:    timeout in milliseconds, and microseconds actually waited
+ */
+inline constexpr std::string_view magic{"UKKOTRC1"};
+
+enum class Record : uint8_t {
+    Command = 1,
+    Data = 2,
+    Pin = 3,
+    Wait = 4,
+};
+
+enum class Pin : uint8_t {
+    Reset = 0,
+    Control = 1,
+};
+
+/**
+ * Recorded event, with time relative to start of trace
+ */
+struct Event {
+    Record type{};
+    std::chrono::microseconds time{};
+    uint8_t command{};
+    std::vector<uint8_t> data{};
+    Pin pin{};
+    bool active{};
+    std::chrono::milliseconds timeout{};
+    std::chrono::microseconds waited{};
+};
+
+/**
+ * Writes events to a trace file as they happen
+ */
+struct Recorder {
+    Recorder(const std::string &filename) : out{filename, std::ios::binary} {
+        if (!out) {
+            throw utils::runtime_error("Unable to open trace file {}", filename);
+        }
+        out.write(magic.data(), magic.size());
+    }
+
+    void command(uint8_t cmd) {
+        begin(Record::Command);
+        out.put(static_cast<char>(cmd));
+    }
+
+    void data(std::span<const uint8_t> bytes) {
+        begin(Record::Data);
+        varint(bytes.size());
+        out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    void pin(Pin pin, bool active) {
+        begin(Record::Pin);
+        out.put(static_cast<char>(static_cast<uint8_t>(pin) << 1 | active));
+    }
+
+    void wait(std::chrono::milliseconds timeout, std::chrono::microseconds waited) {
+        begin(Record::Wait);
+        varint(timeout.count());
+        varint(waited.count());
+        out.flush();
+    }
+
+  private:
+    void begin(Record type) {
+        using namespace std::chrono;
+        const auto now = steady_clock::now();
+        out.put(static_cast<char>(type));
+        varint(duration_cast<microseconds>(now - last).count());
+        last = now;
+    }
+
+    void varint(uint64_t value) {
+        do {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            out.put(static_cast<char>(value ? byte | 0x80 : byte));
+        } while (value);
+    }
+
+    std::ofstream out;
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+/**
+ * Reads events from a trace file
+ */
+struct Reader {
+    Reader(const std::string &filename) : in{filename, std::ios::binary} {
+        std::string header(magic.size(), '\0');
+        if (!in.read(header.data(), header.size()) || header != magic) {
+            throw utils::runtime_error("{} is not a trace file", filename);
+        }
+    }
+
+    /**
+     * Read next event, returns nothing at end of trace
+     */
+    std::optional<Event> next() {
+        const int type = in.get();
+        if (type == std::char_traits<char>::eof()) {
+            return std::nullopt;
+        }
+
+        Event event{.type = static_cast<Record>(type)};
+        time += std::chrono::microseconds(varint());
+        event.time = time;
+        switch (event.type) {
+            case Record::Command:
+                event.command = byte();
+                break;
+
+            case Record::Data:
+                event.data.resize(varint());
+                in.read(reinterpret_cast<char *>(event.data.data()), event.data.size());
+                break;
+
+            case Record::Pin: {
+                const uint8_t value = byte();
+                event.pin = static_cast<Pin>(value >> 1);
+                event.active = value & 1;
+                break;
+            }
+
+            case Record::Wait:
+                event.timeout = std::chrono::milliseconds(varint());
+                event.waited = std::chrono::microseconds(varint());
+                break;
+
+            default:
+                throw utils::runtime_error("Unknown trace record {}", type);
+        }
+
+        if (!in) {
+            throw std::runtime_error("Trace ends in the middle of a record");
+        }
+        return event;
+    }
+
+  private:
+    uint8_t byte() {
+        return static_cast<uint8_t>(in.get());
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (uint32_t shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        return value;
+    }
+
+    std::ifstream in;
+    std::chrono::microseconds time{};
+};
+
+} // namespace trace
@@ -6,13 +6,15 @@
 #include <thread>
 
 #include "common.hpp"
-#include "display.hpp"
+#include "display-worker.hpp"
 #include "forecast.hpp"
 #include "gpio.hpp"
 #include "hwif.hpp"
 #include "message_queue.hpp"
 #include "netatmo.hpp"
+#include "replay.hpp"
 #include "screen.hpp"
+#include "stats.hpp"
 #include "token-storage.hpp"
 #include "ukko.hpp"
 #include "web-server.hpp"
@@ -22,6 +24,7 @@ int main(int argc, char **argv) {
 
     const static option options_available[] = {
         {"dry-run", no_argument, nullptr, 'n'},
+        {"emulate", no_argument, nullptr, 'e'},
         {"verbose", no_argument, nullptr, 'v'},
         {"debug-log", no_argument, nullptr, 'V'},
         {"help", no_argument, nullptr, 'h'},
@@ -31,17 +34,29 @@ int main(int argc, char **argv) {
         {"load-device-data", required_argument, nullptr, 'd'},
         {"store-screen", required_argument, nullptr, 'p'},
         {"store-render", required_argument, nullptr, 'r'},
+        {"store-render-async", no_argument, nullptr, 'a'},
         {"sleep", required_argument, nullptr, 's'},
         {"weather-frequency", required_argument, nullptr, 'W'},
         {"forecast-frequency", required_argument, nullptr, 'Y'},
         {"cycles", required_argument, nullptr, 'c'},
         {"settings", required_argument, nullptr, 'i'},
+        {"update-mode", required_argument, nullptr, 'u'},
+        {"grayscale", no_argument, nullptr, 'g'},
+        {"dual-spi", no_argument, nullptr, 'L'},
+        {"rotate", required_argument, nullptr, 'o'},
+        {"standby-limit", required_argument, nullptr, 'S'},
+        {"fast-refreshes", required_argument, nullptr, 'R'},
+        {"full-refresh-interval", required_argument, nullptr, 'I'},
+        {"store-trace", required_argument, nullptr, 't'},
+        {"replay", required_argument, nullptr, 'T'},
+        {"replay-speed", required_argument, nullptr, 'P'},
         {},
     };
 
     static std::string_view help_text =
         "Usage: ukko [flags]\n"
         " -n | --dry-run                   Do now write to HW interfaces\n"
+        " -e | --emulate                   Draw on an emulated display instead of HW\n"
         " -v | --verbose                   Run in verbose mode\n"
         " -V | --debug-log                 Print debug messages\n"
         " -h | --help                      Print this message and exit\n"
@@ -51,32 +66,78 @@ int main(int argc, char **argv) {
         " -f | --store-forecast <file>     Store forecast data to json formatted file\n"
         " -F | --load-forecast <file>      Load forecast data from json formatted file\n"
         " -r | --store-render <file>       Store rendering to file\n"
+        " -a | --store-render-async        Store rendering in the background\n"
         " -s | --sleep <minutes>           Number of minutes to sleep between refresh\n"
         " -W | --weather-frequency <mins>  Minutes between weather measurements\n"
         " -Y | --forecast-frequency <mins> Minutes between forecast\n"
         " -c | --cycles <cycles>           Number of frames to render before quitting\n"
         "                                  0 cycles means cycle forever\n"
-        " -p | --store-screen <file>       Store screen as image file\n";
+        " -u | --update-mode <mode>        How to update display, 'full', 'differential' or\n"
+        "                                  'partial'\n"
+        " -g | --grayscale                 Draw with four levels of gray\n"
+        " -L | --dual-spi                  Send image data on two data lines, when both the SPI\n"
+        "                                  controller and wiring support it\n"
+        " -o | --rotate <degrees>          Turn rendering clockwise by 0, 90, 180 or 270 degrees\n"
+        "                                  to fit how the panel is mounted\n"
+        " -S | --standby-limit <mins>      Keep display configured if next update is sooner\n"
+        " -R | --fast-refreshes <count>    Fast refreshes allowed between full refreshes\n"
+        " -I | --full-refresh-interval <mins>\n"
+        "                                  Longest time between full refreshes\n"
+        " -p | --store-screen <file>       Store screen as image file\n"
+        " -t | --store-trace <file>        Record display traffic to <file>\n"
+        " -T | --replay <file>             Replay display traffic from <file> and exit\n"
+        " -P | --replay-speed <speed>      Replay at 'original' or 'max' speed\n";
 
     Options options_used{};
 
     while (true) {
         int option_index = 0;
-        c = getopt_long(argc, argv, "c:d:D:nvVhF:f:p:s:r:i:W:Y:", &options_available[0],
-                        &option_index);
+        c = getopt_long(argc, argv, "ac:d:D:egLnvVhF:f:o:p:P:s:S:r:R:i:I:t:T:u:W:Y:",
+                        &options_available[0], &option_index);
         if (c == -1) {
             break;
         }
 
         switch (c) {
+            case 'a':
+                options_used.render_store_async = true;
+                break;
+
             case 'c':
                 options_used.cycles = atoi(optarg);
                 break;
 
+            case 'e':
+                options_used.run_mode = RunMode::Emulated;
+                break;
+
+            case 'g':
+                options_used.grayscale = true;
+                break;
+
+            case 'L':
+                options_used.dual_spi = true;
+                break;
+
             case 'n':
                 options_used.run_mode = RunMode::Dry;
                 break;
 
+            case 'o':
+                if (std::string_view{optarg} == "0") {
+                    options_used.rotation = Rotation::None;
+                } else if (std::string_view{optarg} == "90") {
+                    options_used.rotation = Rotation::Clockwise;
+                } else if (std::string_view{optarg} == "180") {
+                    options_used.rotation = Rotation::UpsideDown;
+                } else if (std::string_view{optarg} == "270") {
+                    options_used.rotation = Rotation::CounterClockwise;
+                } else {
+                    fmt::print("Unknown rotation: {}\n", optarg);
+                    exit(1);
+                }
+                break;
+
             case 'v':
                 options_used.verbose = true;
                 break;
@@ -109,6 +170,18 @@ int main(int argc, char **argv) {
                 options_used.sleep = std::chrono::minutes{atoi(optarg)};
                 break;
 
+            case 'S':
+                options_used.standby_limit = std::chrono::minutes{atoi(optarg)};
+                break;
+
+            case 'R':
+                options_used.fast_refreshes = atoi(optarg);
+                break;
+
+            case 'I':
+                options_used.full_refresh_interval = std::chrono::minutes{atoi(optarg)};
+                break;
+
             case 'W':
                 options_used.weather_frequency = std::chrono::minutes{atoi(optarg)};
                 break;
@@ -121,6 +194,25 @@ int main(int argc, char **argv) {
                 options_used.render_store = optarg;
                 break;
 
+            case 't':
+                options_used.trace_store = optarg;
+                break;
+
+            case 'T':
+                options_used.trace_load = optarg;
+                break;
+
+            case 'P':
+                if (std::string_view{optarg} == "original") {
+                    options_used.replay_speed = ReplaySpeed::Original;
+                } else if (std::string_view{optarg} == "max") {
+                    options_used.replay_speed = ReplaySpeed::Max;
+                } else {
+                    fmt::print("Unknown replay speed: {}\n", optarg);
+                    exit(1);
+                }
+                break;
+
             case 'i':
                 options_used.settings_file = optarg;
                 break;
@@ -132,9 +224,32 @@ int main(int argc, char **argv) {
             case 'D':
                 options_used.netatmo_store = optarg;
                 break;
+
+            case 'u':
+                if (std::string_view{optarg} == "full") {
+                    options_used.update_mode = UpdateMode::Full;
+                } else if (std::string_view{optarg} == "differential") {
+                    options_used.update_mode = UpdateMode::Differential;
+                } else if (std::string_view{optarg} == "partial") {
+                    options_used.update_mode = UpdateMode::Partial;
+                } else {
+                    fmt::print("Unknown update mode: {}\n", optarg);
+                    exit(1);
+                }
+                break;
         }
     }
 
+    /* Display counters are dumped on signal, which no other thread may handle */
+    stats::SignalDumper::block(DisplayWorker<Panel>::dump_signal);
+
+    if (options_used.trace_load) {
+        hwif::Pins pins{options_used};
+        hwif::Hwif<Panel> hwif{options_used, pins};
+        trace::replay(options_used, hwif, *options_used.trace_load);
+        return 0;
+    }
+
     if (access(options_used.settings_file.c_str(), R_OK) != 0) {
         fmt::print("Missing settings file {}\n", options_used.settings_file);
         return -1;
@@ -205,8 +320,24 @@ int Ukko::run() {
         /* We have new information to display */
         if (update_screen) {
             debug("Updating screen with new information");
-            screen.draw(forecast_data, weather_data);
-            display.draw(screen.get_ptr());
+
+            /* Updates are only made when the loop wakes up, so never sooner than a sleep away */
+            const auto next_update =
+                std::max(std::min(weather_time + settings.weather_frequency,
+                                  forecast_time + settings.forecast_frequency),
+                         now + settings.sleep);
+
+            /* Submitting does not wait for the panel to refresh, so all panels refresh together.
+             * Frames where nothing changed are never submitted, which leaves the panel asleep */
+            for (const std::unique_ptr<Output> &output : outputs) {
+                const std::vector<Rect> changed = output->screen.draw(forecast_data, weather_data);
+                if (changed.empty()) {
+                    debug("Nothing shown changed, leaving display as is");
+                    continue;
+                }
+                debug("Changed regions, before turning to fit panel: {}", changed);
+                output->display_worker.submit(output->screen.get_framebuffer(), next_update);
+            }
         }
 
         if (std::optional<Auth> auth = queue.pop(now + settings.sleep)) {
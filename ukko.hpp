@@ -1,26 +1,25 @@
 #pragma once
 
-#include "display.hpp"
+#include <memory>
+#include <vector>
+
+#include "display-worker.hpp"
 #include "forecast.hpp"
-#include "gpio.hpp"
-#include "hwif.hpp"
 #include "netatmo.hpp"
+#include "panel.hpp"
 #include "screen.hpp"
 #include "settings.hpp"
+#include "stats.hpp"
+
+/* Panel the HAT is fitted with */
+using Panel = panel::Waveshare7in5V2;
 
 struct Ukko {
     Ukko(Settings &&settings)
         : log{settings.get_logger(Logger::Facility::Ukko, true)}
         , debug{settings.get_logger(Logger::Facility::Ukko)}
         , settings{settings}
-	, screen{settings}
-	, control_pins {
-		.reset { gpio::Output(settings, gpio::Active::Low, 17, "eink-reset") },
-		.control { gpio::Output(settings, gpio::Active::Low, 25, "eink-control") },
-		.busy { gpio::Input(settings, 24, "eink-busy") },
-	}
-	,hwif{settings, control_pins}
-	,display{settings, hwif}
+        , outputs{make_outputs(this->settings)}
 	,weather_service{settings}
 	,forecast_service{settings}
 	,position {settings.position} {
@@ -29,15 +28,43 @@ struct Ukko {
     int run();
 
   private:
+    /* Screen of one panel, and worker drawing it in the background */
+    struct Output {
+        Output(Options &&options, const Layout &layout)
+            : options{std::move(options)}
+            , screen{this->options, layout}
+            , display_worker{this->options} {
+        }
+
+        const Options options;
+        Screen<Panel> screen;
+        DisplayWorker<Panel> display_worker;
+    };
+
+    static std::vector<std::unique_ptr<Output>> make_outputs(const Settings &settings) {
+        std::vector<std::unique_ptr<Output>> outputs{};
+        for (size_t i = 0; i < settings.panels.size(); i++) {
+            outputs.push_back(
+                std::make_unique<Output>(settings.panel_options(i), settings.panels[i].layout));
+        }
+        return outputs;
+    }
+
+    void dump_stats() {
+        for (const std::unique_ptr<Output> &output : outputs) {
+            output->display_worker.dump_stats();
+        }
+    }
+
     Logger log;
     Logger debug;
     Settings settings;
 
-    /* Prepare screen and interfaces */
-    Screen screen;
-    hwif::Pins control_pins;
-    hwif::Hwif hwif;
-    Display display;
+    /* Each panel refreshes on a thread of its own, so the panels update at the same time */
+    std::vector<std::unique_ptr<Output>> outputs;
+
+    /* Only one thread receives the signal, so it dumps counters of all panels */
+    stats::SignalDumper dumper{DisplayWorker<Panel>::dump_signal, [this] { dump_stats(); }};
 
     /* Set up weather service handlers */
     Weather weather_service;
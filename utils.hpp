@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <fmt/core.h>
 #include <iomanip>
@@ -48,6 +49,16 @@ template <typename T> inline constexpr T round_down(T val, T mul) {
     return mul * div_floor(val, mul);
 }
 
+/**
+ * Reverse the order of bits in a byte
+ */
+inline constexpr uint8_t reverse_bits(uint8_t byte) {
+    byte = (byte & 0xf0) >> 4 | (byte & 0x0f) << 4;
+    byte = (byte & 0xcc) >> 2 | (byte & 0x33) << 2;
+    byte = (byte & 0xaa) >> 1 | (byte & 0x55) << 1;
+    return byte;
+}
+
 /**
  * Calculate the absolute difference between two values
  */
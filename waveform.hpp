@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "common.hpp"
+
+namespace waveform {
+
+/**
+ * Look up table for the display controller. Consists of seven groups of six bytes, where the first
+ * byte holds the voltage level of four phases, the next four bytes the number of frames for each
+ * phase, and the last byte how many times the group is repeated
+ */
+using Lut = std::array<uint8_t, 42>;
+
+/**
+ * Set of look up tables used for a refresh. The pixel tables are selected by the old and new
+ * value of each pixel
+ */
+struct Profile {
+    std::string_view name;
+    Lut vcom;
+    Lut ww;
+    Lut bw;
+    Lut wb;
+    Lut bb;
+};
+
+/* Slow refresh, that drives every pixel back and forth to clean up ghosting */
+inline constexpr Profile full{
+    .name = "full",
+    .vcom = {0x0, 0xF, 0xF, 0x0, 0x0, 0x1, 0x0, 0xF, 0x1, 0xF, 0x1, 0x2, 0x0, 0xF,
+             0xF, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+             0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0},
+    .ww = {0x10, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x20, 0xF,
+           0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
+           0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0},
+    .bw = {0x10, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x20, 0xF,
+           0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
+           0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0},
+    .wb = {0x80, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x40, 0xF,
+           0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
+           0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0},
+    .bb = {0x80, 0xF, 0xF, 0x0, 0x0, 0x1, 0x84, 0xF, 0x1, 0xF, 0x1, 0x2, 0x40, 0xF,
+           0xF,  0x0, 0x0, 0x1, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0,
+           0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0, 0x0, 0x0, 0x0, 0x0, 0x0,  0x0},
+};
+
+/* Quick refresh, with a single group that only drives pixels changing color */
+inline constexpr Profile fast{
+    .name = "fast",
+    .vcom = {0x00, 0x1E, 0x05, 0x1E, 0x05, 0x1},
+    .ww = {0x00, 0x1E, 0x05, 0x1E, 0x05, 0x1},
+    .bw = {0x48, 0x1E, 0x05, 0x1E, 0x05, 0x1},
+    .wb = {0x84, 0x1E, 0x05, 0x1E, 0x05, 0x1},
+    .bb = {0x00, 0x1E, 0x05, 0x1E, 0x05, 0x1},
+};
+
+/* Four level grayscale. Each pixel takes its old and new bit from the two transmitted planes, which
+ * together give its level from white (ww) over light gray (wb) and dark gray (bw) to black (bb) */
+inline constexpr Profile gray{
+    .name = "gray",
+    .vcom = {0x00, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x60, 0x14, 0x14, 0x00, 0x00, 0x01, 0x00, 0x14,
+             0x00, 0x00, 0x00, 0x01, 0x00, 0x13, 0x0A, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+             0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    .ww = {0x40, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x90, 0x14, 0x14, 0x00, 0x00, 0x01, 0x00, 0x14,
+           0x0A, 0x00, 0x00, 0x01, 0x99, 0x0B, 0x04, 0x04, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00,
+           0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    .bw = {0x40, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x90, 0x14, 0x14, 0x00, 0x00, 0x01, 0x00, 0x14,
+           0x0A, 0x00, 0x00, 0x01, 0x99, 0x0C, 0x01, 0x03, 0x04, 0x01, 0x02, 0x04, 0x01, 0x03,
+           0x04, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    .wb = {0x40, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x90, 0x14, 0x14, 0x00, 0x00, 0x01, 0x10, 0x14,
+           0x0A, 0x00, 0x00, 0x01, 0xA0, 0x13, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+           0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+    .bb = {0x80, 0x0A, 0x00, 0x00, 0x00, 0x01, 0x90, 0x14, 0x14, 0x00, 0x00, 0x01, 0x20, 0x14,
+           0x0A, 0x00, 0x00, 0x01, 0x50, 0x13, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+           0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/**
+ * Decides when a fast refresh is good enough, and when a full refresh is needed to clean up the
+ * ghosting that fast refreshes leave behind. Waveforms are taken from `Panel`
+ */
+template <typename Panel> struct Scheduler {
+    struct Choice {
+        const Profile &profile;
+        /* Display needs to be cleaned, rather than just updated */
+        bool cleaning;
+    };
+
+    Scheduler(const Options &options) : options(options) {
+    }
+
+    /**
+     * Choose waveform for a refresh happening at `now`, with the panel at `temperature` if known
+     */
+    Choice choose(std::chrono::steady_clock::time_point now,
+                  std::optional<int> temperature) const {
+        if (options.fast_refreshes == 0 ||
+            (temperature && *temperature < Panel::fast_min_temperature)) {
+            return {Panel::full, false};
+        }
+        if (fast_count >= options.fast_refreshes ||
+            now - last_full >= options.full_refresh_interval) {
+            return {Panel::full, true};
+        }
+        return {Panel::fast, false};
+    }
+
+    /**
+     * Keep track of a refresh using `profile` made at `now`
+     */
+    void record(const Profile &profile, std::chrono::steady_clock::time_point now) {
+        if (&profile == &Panel::fast) {
+            fast_count += 1;
+        } else {
+            fast_count = 0;
+            last_full = now;
+        }
+    }
+
+  private:
+    const Options &options;
+    uint32_t fast_count = 0;
+    std::chrono::steady_clock::time_point last_full = std::chrono::steady_clock::now();
+};
+
+} // namespace waveform